@@ -0,0 +1,29 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+// Replaced global operator new/delete for the benchmarks. They live in their own translation unit and stay
+// out of line, so callers always pair a call to operator new with a call to operator delete: inlined, the
+// new side became malloc() and GCC's -Wmismatched-new-delete flagged it against the delete call.
+
+#include "alloc_count.h"
+#include <cstdlib>
+#include <new>
+
+
+std::atomic<size_t> allocationCount{0};
+std::atomic<size_t> allocationBytes{0};
+
+__attribute__((noinline)) void* operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocationBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* block = std::malloc(size ? size : 1)) return block;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+__attribute__((noinline)) void operator delete(void* block) noexcept { std::free(block); }
+__attribute__((noinline)) void operator delete[](void* block) noexcept { std::free(block); }
+__attribute__((noinline)) void operator delete(void* block, size_t) noexcept { std::free(block); }
+__attribute__((noinline)) void operator delete[](void* block, size_t) noexcept { std::free(block); }
@@ -0,0 +1,13 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+#include <atomic>
+#include <cstddef>
+
+
+// Heap allocations of the whole process, counted by the global operator new replaced in alloc_count.cpp
+extern std::atomic<size_t> allocationCount;
+extern std::atomic<size_t> allocationBytes;
+
+#endif // ALLOC_COUNT_H
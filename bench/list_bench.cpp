@@ -0,0 +1,267 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+// Select-filter-render loop benchmark: sorting the loaded list, building its index, filtering it
+// (as the list prompt does, as plain strings and the old per-file Boyer-Moore way), splitting paths
+// for display and printing the list, over synthetic archive-like path lists.
+// Reports latency, heap allocations and throughput per stage; --json FILE also writes one JSON object
+// per measurement for comparing runs. Build and run with "make bench".
+
+#include "../src/headers.h"
+#include "../src/search.h"
+#include "alloc_count.h"
+#include <iomanip>
+
+
+// Function to build a deterministic list of paths shaped like a real ISO archive: a few roots,
+// category and year folders of varying depth, versioned release names, mixed case and some non-ASCII names
+static std::vector<std::string> syntheticArchive(size_t count) {
+    static const char* const roots[] = {"/home/alex/Downloads", "/mnt/nas/Archive", "/media/alex/Backup Drive", "/srv/isos", "/root/images", "/home/alex/Documents/Old Stuff"};
+    static const char* const categories[] = {"Linux", "Windows", "Games", "BSD", "Tools", "Rescue", "Música", "Фильмы", "Ελληνικά", "Work_Projects"};
+    static const char* const subfolders[] = {"x86_64", "amd64", "arm64", "disc1", "disc2", "netinst", "live", "server", "desktop", "extras"};
+    static const char* const releases[] = {"ubuntu", "debian", "Fedora-Workstation-Live", "archlinux", "Windows_11", "FreeBSD", "openSUSE-Tumbleweed", "linuxmint", "Game Collection Disc", "Backup_Photos", "Crème Brûlée Demo", "Проект"};
+    static const char* const variants[] = {"desktop", "server", "netinst", "DVD", "cinnamon", "RELEASE", "English", "x64", "Live", "full"};
+    static const char* const arches[] = {"amd64", "x86_64", "i386", "arm64", "64bit"};
+
+    std::mt19937_64 rng(2024);
+    auto pick = [&rng](const auto& options) { return options[rng() % (sizeof(options) / sizeof(options[0]))]; };
+
+    std::vector<std::string> paths;
+    paths.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        std::string path = pick(roots);
+        path += '/';
+        path += pick(categories);
+        if (rng() % 2 == 0) path += '/' + std::to_string(2005 + rng() % 20);
+        for (size_t depth = rng() % 4; depth > 0; --depth) {
+            path += '/';
+            path += pick(subfolders);
+        }
+        path += '/';
+        path += pick(releases);
+        path += '-' + std::to_string(1 + rng() % 40) + '.' + std::to_string(rng() % 12);
+        path += '-';
+        path += pick(variants);
+        if (rng() % 3 != 0) {
+            path += '-';
+            path += pick(arches);
+        }
+        path += '_' + std::to_string(rng() % 100000);
+        path += (rng() % 5 == 0) ? ".ISO" : ".iso";
+        paths.push_back(std::move(path));
+    }
+    return paths;
+}
+
+
+// Output sink for printList, so rendering is measured without the terminal
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+};
+
+
+// One stage measured over several runs
+struct Measurement {
+    std::string stage;
+    size_t rows = 0;
+    std::string query;
+    size_t runs = 0;
+    double bestMs = 0;
+    double medianMs = 0;
+    double rowsPerSecond = 0;     // Rows the stage went through per second at the median
+    size_t allocations = 0;       // Per run
+    size_t allocatedBytes = 0;    // Per run
+    size_t result = 0;            // Matches, rows printed or rows sorted
+};
+
+
+// Function to time a stage: setup runs untimed before every run, work returns the stage's result size
+template <typename Setup, typename Work>
+static Measurement measure(const std::string& stage, size_t rows, const std::string& query, size_t runs, size_t processedRows, Setup setup, Work work) {
+    Measurement result;
+    result.stage = stage;
+    result.rows = rows;
+    result.query = query;
+    result.runs = runs;
+
+    std::vector<double> times;
+    size_t totalAllocations = 0, totalBytes = 0;
+    for (size_t run = 0; run < runs; ++run) {
+        setup();
+        size_t countBefore = allocationCount.load(std::memory_order_relaxed);
+        size_t bytesBefore = allocationBytes.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        result.result = work();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        totalAllocations += allocationCount.load(std::memory_order_relaxed) - countBefore;
+        totalBytes += allocationBytes.load(std::memory_order_relaxed) - bytesBefore;
+        times.push_back(elapsed.count());
+    }
+
+    std::sort(times.begin(), times.end());
+    result.bestMs = times.front();
+    result.medianMs = times[times.size() / 2];
+    result.rowsPerSecond = result.medianMs > 0 ? processedRows / (result.medianMs / 1000.0) : 0;
+    result.allocations = totalAllocations / runs;
+    result.allocatedBytes = totalBytes / runs;
+    return result;
+}
+
+
+// Function to quote a string for JSON
+static std::string jsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            quoted += escaped;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+
+// Function to print a measurement as a table row and, when a JSON file is open, as one JSON line
+static void report(const Measurement& m, std::ofstream& json) {
+    std::cout << std::left << std::setw(9) << m.rows << std::setw(16) << m.stage << std::setw(34) << m.query
+              << std::right << std::fixed << std::setprecision(3) << std::setw(11) << m.medianMs << std::setw(11) << m.bestMs
+              << std::setprecision(1) << std::setw(10) << m.rowsPerSecond / 1e6 << std::setw(10) << m.allocations
+              << std::setw(12) << m.allocatedBytes / 1024 << std::setw(9) << m.result << "\n";
+    if (json.is_open()) {
+        json << std::fixed << std::setprecision(4)
+             << "{\"stage\":" << jsonString(m.stage) << ",\"rows\":" << m.rows << ",\"query\":" << jsonString(m.query)
+             << ",\"runs\":" << m.runs << ",\"median_ms\":" << m.medianMs << ",\"best_ms\":" << m.bestMs
+             << ",\"rows_per_s\":" << std::setprecision(0) << m.rowsPerSecond << ",\"allocations\":" << m.allocations
+             << ",\"allocated_bytes\":" << m.allocatedBytes << ",\"result\":" << m.result << "}\n";
+    }
+}
+
+
+int main(int argc, char* argv[]) {
+    std::vector<size_t> sizes;
+    std::ofstream json;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc) {
+            json.open(argv[++i]);
+            if (!json.is_open()) {
+                std::cerr << "cannot write " << argv[i] << "\n";
+                return 1;
+            }
+        } else {
+            sizes.push_back(std::stoul(arg));
+        }
+    }
+    if (sizes.empty()) sizes = {10000, 100000, 1000000};
+
+    // Plain terms, alternatives, fuzzy, field qualifiers, a regex and a term that matches nothing
+    const std::vector<std::string> queries = {"iso", "debian", "ubuntu;fedora", "~ubu2404", "ext:iso name:live NOT dir:backup", "re:-(19|2[0-4])\\.\\d+-", "nomatch"};
+
+    NullBuffer nullBuffer;
+    std::cout << std::left << std::setw(9) << "rows" << std::setw(16) << "stage" << std::setw(34) << "query" << std::right
+              << std::setw(11) << "median ms" << std::setw(11) << "best ms" << std::setw(10) << "Mrows/s" << std::setw(10) << "allocs"
+              << std::setw(12) << "alloc KiB" << std::setw(9) << "result" << "\n";
+
+    for (size_t size : sizes) {
+        const size_t runs = size >= 1000000 ? 3 : 5;
+        const std::vector<std::string> corpus = syntheticArchive(size);
+
+        // The cache loads paths unsorted, the list is sorted once per load
+        std::vector<std::string> unsorted;
+        report(measure("sort", size, "", runs, size, [&] { unsorted = corpus; }, [&] {
+            sortFilesCaseInsensitive(unsorted);
+            return unsorted.size();
+        }), json);
+        globalIsoFileList = std::move(unsorted);
+
+        report(measure("index", size, "", runs, size, [] {}, [] {
+            globalIsoSearchIndex.build(globalIsoFileList);
+            return globalIsoSearchIndex.size();
+        }), json);
+
+        // What the filter scanned before the index existed: one normalized string per file
+        std::vector<std::string> normalized(globalIsoFileList.size());
+        for (size_t i = 0; i < globalIsoFileList.size(); ++i) {
+            appendNormalized(globalIsoFileList[i], normalized[i]);
+        }
+
+        ListView fullView(globalIsoFileList);
+        for (const std::string& query : queries) {
+            std::vector<uint32_t> rows;
+            report(measure("filter", size, query, runs, size, [] {}, [&] {
+                rows = filterRows(fullView, query);
+                return rows.size();
+            }), json);
+
+            report(measure("filter_strings", size, query, runs, size, [] {}, [&] {
+                return filterFiles(globalIsoFileList, query).size();
+            }), json);
+
+            // The old scan only handled single plain terms
+            if (!isFuzzyQuery(query) && query.find_first_of(": ;") == std::string::npos) {
+                report(measure("boyermoore", size, query, runs, size, [] {}, [&] {
+                    size_t matches = 0;
+                    for (const std::string& row : normalized) {
+                        matches += boyerMooreSearch(query, row).empty() ? 0 : 1;
+                    }
+                    return matches;
+                }), json);
+            }
+
+            // Drawing the filtered list, as the prompt does after every filter
+            ListView filteredView(globalIsoFileList);
+            filteredView.setRows(rows);
+            std::streambuf* terminal = std::cout.rdbuf(&nullBuffer);
+            Measurement render = measure("render", size, query, runs, rows.size(), [] {}, [&] {
+                printList(filteredView, "ISO_FILES");
+                return filteredView.size();
+            });
+            std::cout.rdbuf(terminal);
+            report(render, json);
+        }
+
+        // A second filter only tests the rows the first one kept
+        ListView narrowed(globalIsoFileList);
+        narrowed.setRows(filterRows(narrowed, "linux"));
+        report(measure("filter_nested", size, "linux > amd64", runs, narrowed.size(), [] {}, [&] {
+            return filterRows(narrowed, "amd64").size();
+        }), json);
+
+        // Directory shortening for display, cold fills the transformation cache, warm reads it back
+        report(measure("split_cold", size, "", runs, size, [] { transformationCache.clear(); }, [] {
+            size_t bytes = 0;
+            for (const std::string& path : globalIsoFileList) {
+                bytes += extractDirectoryAndFilename(path).first.size();
+            }
+            return bytes;
+        }), json);
+        report(measure("split_warm", size, "", runs, size, [] {}, [] {
+            size_t bytes = 0;
+            for (const std::string& path : globalIsoFileList) {
+                bytes += extractDirectoryAndFilename(path).first.size();
+            }
+            return bytes;
+        }), json);
+
+        std::streambuf* terminal = std::cout.rdbuf(&nullBuffer);
+        Measurement renderFull = measure("render_full", size, "", runs, size, [] {}, [] {
+            printList(globalIsoFileList, "ISO_FILES");
+            return globalIsoFileList.size();
+        });
+        std::cout.rdbuf(terminal);
+        report(renderFull, json);
+        std::cout << "\n";
+
+        transformationCache.clear();
+        globalIsoSearchIndex.clear();
+        globalIsoFileList.clear();
+    }
+    return 0;
+}
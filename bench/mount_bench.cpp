@@ -0,0 +1,190 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+// Mount-all benchmark: mounts and unmounts batches of small ISO 9660 images the way a "00" mount does,
+// with libmount setting up its own loop devices, with the loop-device pool and libmount, and with the pool
+// and the fsopen/fsmount/move_mount API. Needs root and a kernel with iso9660 support.
+// Usage: mount_bench [--json FILE] [--dir DIR] [sizes...], default sizes 100 1000 5000.
+
+#include "../src/headers.h"
+#include "../src/threadpool.h"
+#include "../src/loopdev.h"
+#include "../src/mounttable.h"
+#include <iomanip>
+
+
+// Function to write a minimal ISO 9660 image: volume descriptors, path tables and an empty root directory
+static bool writeMinimalIso(const std::string& path) {
+    constexpr size_t SECTOR = 2048;
+    constexpr uint32_t ROOT_SECTOR = 20;
+    std::vector<unsigned char> image(SECTOR * (ROOT_SECTOR + 1), 0);
+
+    auto both32 = [](unsigned char* out, uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            out[i] = static_cast<unsigned char>(value >> (8 * i));
+            out[7 - i] = static_cast<unsigned char>(value >> (8 * i));
+        }
+    };
+    auto both16 = [](unsigned char* out, uint16_t value) {
+        out[0] = out[3] = static_cast<unsigned char>(value);
+        out[1] = out[2] = static_cast<unsigned char>(value >> 8);
+    };
+    auto directoryRecord = [&](unsigned char* out, unsigned char name) {
+        out[0] = 34;
+        both32(out + 2, ROOT_SECTOR);
+        both32(out + 10, SECTOR);
+        out[25] = 2; // Directory
+        both16(out + 28, 1);
+        out[32] = 1;
+        out[33] = name;
+    };
+
+    unsigned char* pvd = image.data() + 16 * SECTOR;
+    pvd[0] = 1;
+    std::memcpy(pvd + 1, "CD001", 5);
+    pvd[6] = 1;
+    std::memset(pvd + 8, ' ', 64);
+    std::memcpy(pvd + 40, "MOUNT_BENCH", 11);
+    both32(pvd + 80, ROOT_SECTOR + 1);
+    both16(pvd + 120, 1);
+    both16(pvd + 124, 1);
+    both16(pvd + 128, SECTOR);
+    both32(pvd + 132, 10);
+    pvd[140] = 18;                 // Little-endian path table
+    pvd[151] = 19;                 // Big-endian path table
+    directoryRecord(pvd + 156, 0);
+    pvd[881] = 1;
+
+    unsigned char* terminator = image.data() + 17 * SECTOR;
+    terminator[0] = 255;
+    std::memcpy(terminator + 1, "CD001", 5);
+    terminator[6] = 1;
+
+    unsigned char* littleTable = image.data() + 18 * SECTOR;
+    unsigned char* bigTable = image.data() + 19 * SECTOR;
+    littleTable[0] = bigTable[0] = 1;
+    littleTable[2] = ROOT_SECTOR;
+    bigTable[5] = ROOT_SECTOR;
+    littleTable[6] = 1;
+    bigTable[7] = 1;
+
+    directoryRecord(image.data() + ROOT_SECTOR * SECTOR, 0);
+    directoryRecord(image.data() + ROOT_SECTOR * SECTOR + 34, 1);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(image.data()), static_cast<std::streamsize>(image.size()));
+    return static_cast<bool>(out);
+}
+
+
+// Mount path being measured
+struct Backend {
+    const char* name;
+    bool loopPool;
+    bool fsContext;
+};
+
+
+// Function to mount a batch in chunks of 50 on all threads, as processAndMountIsoFiles does
+static size_t mountBatch(const std::vector<std::string>& isoFiles, const Backend& backend) {
+    std::set<std::string> mountedFiles, skippedMessages, mountedFails;
+    globalMountTable.refresh();
+    LoopDevicePool loopPool(backend.loopPool ? isoFiles.size() : 0);
+
+    size_t numThreads = std::max<size_t>(1, std::min<size_t>(maxThreads, isoFiles.size()));
+    size_t chunkSize = std::max<size_t>(1, std::min<size_t>(50, (isoFiles.size() + numThreads - 1) / numThreads));
+    std::mutex resultsMutex;
+    ThreadPool pool(numThreads);
+    std::vector<std::future<void>> futures;
+    for (size_t begin = 0; begin < isoFiles.size(); begin += chunkSize) {
+        size_t end = std::min(begin + chunkSize, isoFiles.size());
+        futures.push_back(pool.enqueue([&, begin, end]() {
+            std::vector<std::string> chunk(isoFiles.begin() + begin, isoFiles.begin() + end);
+            std::set<std::string> chunkMounted, chunkSkipped, chunkFails;
+            mountIsoFiles(chunk, chunkMounted, chunkSkipped, chunkFails, backend.loopPool ? &loopPool : nullptr, backend.fsContext);
+            std::lock_guard<std::mutex> lock(resultsMutex);
+            mountedFiles.insert(chunkMounted.begin(), chunkMounted.end());
+            mountedFails.insert(chunkFails.begin(), chunkFails.end());
+        }));
+    }
+    for (auto& future : futures) {
+        future.get();
+    }
+    if (!mountedFails.empty()) {
+        std::cerr << removeAnsiCodes(*mountedFails.begin()) << "\n";
+    }
+    return mountedFiles.size();
+}
+
+
+int main(int argc, char* argv[]) {
+    std::vector<size_t> sizes;
+    std::string workDir = "/tmp/isocmd_mount_bench";
+    std::ofstream json;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc) {
+            json.open(argv[++i]);
+        } else if (arg == "--dir" && i + 1 < argc) {
+            workDir = argv[++i];
+        } else {
+            sizes.push_back(std::stoul(arg));
+        }
+    }
+    if (sizes.empty()) sizes = {100, 1000, 5000};
+
+    if (geteuid() != 0) {
+        std::cerr << "mount_bench needs root\n";
+        return 1;
+    }
+    std::filesystem::create_directories(workDir);
+    const std::string image = workDir + "/image.iso";
+    if (!writeMinimalIso(image)) {
+        std::cerr << "cannot write " << image << "\n";
+        return 1;
+    }
+
+    const Backend backends[] = {{"libmount", false, false}, {"pool+libmount", true, false}, {"pool+fsmount", true, true}};
+    std::cout << std::left << std::setw(8) << "isos" << std::setw(16) << "backend" << std::right << std::setw(12) << "mount ms"
+              << std::setw(12) << "mounts/s" << std::setw(12) << "umount ms" << std::setw(10) << "mounted" << "\n";
+
+    for (size_t size : sizes) {
+        // Hard links of one image, every link still gets its own loop device and mount point
+        std::vector<std::string> isoFiles;
+        for (size_t i = 0; i < size; ++i) {
+            std::string link = workDir + "/bench_" + std::to_string(i) + ".iso";
+            if (access(link.c_str(), F_OK) != 0 && ::link(image.c_str(), link.c_str()) != 0) {
+                std::cerr << "cannot link " << link << ": " << strerror(errno) << "\n";
+                return 1;
+            }
+            isoFiles.push_back(std::move(link));
+        }
+
+        for (const Backend& backend : backends) {
+            auto start = std::chrono::steady_clock::now();
+            size_t mounted = mountBatch(isoFiles, backend);
+            std::chrono::duration<double, std::milli> mountTime = std::chrono::steady_clock::now() - start;
+
+            std::vector<std::string> mountPoints;
+            for (const std::string& isoFile : isoFiles) {
+                mountPoints.push_back(isoMountPoint(isoFile));
+            }
+            std::set<std::string> unmounted, unmountErrors;
+            start = std::chrono::steady_clock::now();
+            unmountISO(mountPoints, unmounted, unmountErrors);
+            std::chrono::duration<double, std::milli> umountTime = std::chrono::steady_clock::now() - start;
+
+            double rate = mountTime.count() > 0 ? mounted / (mountTime.count() / 1000.0) : 0;
+            std::cout << std::left << std::setw(8) << size << std::setw(16) << backend.name << std::right << std::fixed
+                      << std::setprecision(1) << std::setw(12) << mountTime.count() << std::setw(12) << rate
+                      << std::setw(12) << umountTime.count() << std::setw(10) << mounted << "\n";
+            if (json.is_open()) {
+                json << std::fixed << std::setprecision(3) << "{\"isos\":" << size << ",\"backend\":\"" << backend.name
+                     << "\",\"mount_ms\":" << mountTime.count() << ",\"mounts_per_s\":" << rate
+                     << ",\"umount_ms\":" << umountTime.count() << ",\"mounted\":" << mounted << "}\n";
+            }
+        }
+    }
+
+    std::filesystem::remove_all(workDir);
+    return 0;
+}
@@ -0,0 +1,149 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+// Substring search benchmark: the old per-file Boyer-Moore, memmem, every kernel the CPU supports,
+// the pattern DFA, fuzzy scoring and the trigram index, single-threaded over synthetic path lists. Build and run with "make bench".
+
+#include "../src/headers.h"
+#include "../src/search.h"
+#include <iomanip>
+
+
+// Function to build a deterministic list of ISO-like paths
+static std::vector<std::string> syntheticPaths(size_t count) {
+    static const char* const dirs[] = {"home", "user", "Downloads", "isos", "mnt", "data", "Archive", "linux", "games", "backup", "media", "Old Stuff"};
+    static const char* const names[] = {"ubuntu-24.04-desktop-amd64", "debian-12.5.0-amd64-netinst", "Fedora-Workstation-Live-x86_64-40", "archlinux-2024.06.01-x86_64", "Windows_11_23H2_English", "FreeBSD-14.1-RELEASE-amd64-disc1", "openSUSE-Tumbleweed-DVD", "linuxmint-21.3-cinnamon-64bit", "Game Collection Disc", "Backup_2019_Photos"};
+    std::mt19937_64 rng(42);
+    std::vector<std::string> paths;
+    paths.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        std::string path;
+        size_t depth = 2 + rng() % 5;
+        for (size_t d = 0; d < depth; ++d) {
+            path += '/';
+            path += dirs[rng() % (sizeof(dirs) / sizeof(dirs[0]))];
+        }
+        path += '/';
+        path += names[rng() % (sizeof(names) / sizeof(names[0]))];
+        path += '_' + std::to_string(rng() % 100000);
+        path += (rng() % 4 == 0) ? ".ISO" : ".iso";
+        paths.push_back(std::move(path));
+    }
+    return paths;
+}
+
+
+// Function to time one matcher over every row, best of a few runs to hide warm-up noise
+template <typename Matcher>
+static double bestMilliseconds(size_t rows, Matcher matches, size_t& hits) {
+    double best = 1e300;
+    for (int run = 0; run < 3; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        size_t count = 0;
+        for (size_t i = 0; i < rows; ++i) {
+            count += matches(i) ? 1 : 0;
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+        hits = count;
+    }
+    return best;
+}
+
+
+int main(int argc, char* argv[]) {
+    std::vector<size_t> sizes = {10000, 100000, 1000000};
+    if (argc > 1) {
+        sizes.clear();
+        for (int i = 1; i < argc; ++i) {
+            sizes.push_back(std::stoul(argv[i]));
+        }
+    }
+    const std::vector<std::string> queries = {"x", "iso", "debian", "fedora-workstation-live", "nomatch"};
+
+    std::cout << "kernel selected at runtime: " << substringKernelName(bestSubstringKernel()) << "\n\n";
+    std::cout << std::left << std::setw(10) << "rows" << std::setw(26) << "query" << std::setw(12) << "matcher" << std::right << std::setw(12) << "ms" << std::setw(12) << "ns/row" << std::setw(10) << "hits" << "\n";
+
+    for (size_t size : sizes) {
+        std::vector<std::string> paths = syntheticPaths(size);
+        SearchIndex index;
+        index.build(paths);
+
+        SearchIndex trigramIndex;
+        trigramIndex.build(paths);
+        auto buildStart = std::chrono::steady_clock::now();
+        trigramIndex.enableTrigrams(1);
+        std::chrono::duration<double, std::milli> buildTime = std::chrono::steady_clock::now() - buildStart;
+        std::cout << "trigram index over " << size << " rows built in " << std::fixed << std::setprecision(1) << buildTime.count() << " ms\n";
+
+        // What the filter scanned before the index existed: one normalized string per file
+        std::vector<std::string> normalized(paths.size());
+        for (size_t i = 0; i < paths.size(); ++i) {
+            appendNormalized(paths[i], normalized[i]);
+        }
+
+        for (const std::string& query : queries) {
+            std::vector<std::pair<std::string, double>> timings;
+            size_t referenceHits = 0;
+            size_t hits = 0;
+
+            timings.emplace_back("boyermoore", bestMilliseconds(size, [&](size_t i) { return !boyerMooreSearch(query, normalized[i]).empty(); }, referenceHits));
+            timings.emplace_back("memmem", bestMilliseconds(size, [&](size_t i) {
+                std::string_view row = index.row(i);
+                return memmem(row.data(), row.size(), query.data(), query.size()) != nullptr;
+            }, hits));
+            bool consistent = hits == referenceHits;
+
+            for (SubstringKernel kernel : {SubstringKernel::Scalar, SubstringKernel::Sse2, SubstringKernel::Avx2, SubstringKernel::Avx512}) {
+                if (!substringKernelSupported(kernel)) continue;
+                CompiledToken token(query, kernel);
+                timings.emplace_back(substringKernelName(kernel), bestMilliseconds(size, [&](size_t i) { return token.foundIn(index.row(i)); }, hits));
+                consistent = consistent && hits == referenceHits;
+            }
+
+            // The same literal as a regex run through the pattern DFA
+            PatternDfa dfa;
+            std::string dfaError;
+            if (dfa.compileRegex(query, dfaError)) {
+                timings.emplace_back("dfa", bestMilliseconds(size, [&](size_t i) { return dfa.matches(index.row(i)); }, hits));
+                consistent = consistent && hits == referenceHits;
+            }
+
+            // Fuzzy scoring of every row, matches are a superset of the substring hits
+            size_t fuzzyHits = 0;
+            timings.emplace_back("fuzzy", bestMilliseconds(size, [&](size_t i) {
+                int score = 0;
+                return fuzzyMatch(index.row(i), query, score);
+            }, fuzzyHits));
+            consistent = consistent && fuzzyHits >= referenceHits;
+
+            // Candidate lookup plus verification, reported per row of the whole list for comparison
+            std::vector<CompiledToken> tokens{CompiledToken(query)};
+            std::vector<uint32_t> candidates;
+            if (trigramIndex.candidateRows(tokens, candidates)) {
+                double best = 1e300;
+                for (int run = 0; run < 3; ++run) {
+                    auto start = std::chrono::steady_clock::now();
+                    trigramIndex.candidateRows(tokens, candidates);
+                    hits = 0;
+                    for (uint32_t row : candidates) {
+                        hits += tokens.front().foundIn(trigramIndex.row(row)) ? 1 : 0;
+                    }
+                    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+                    best = std::min(best, elapsed.count());
+                }
+                timings.emplace_back("trigram", best);
+                consistent = consistent && hits == referenceHits;
+            }
+
+            for (const auto& [name, ms] : timings) {
+                std::cout << std::left << std::setw(10) << size << std::setw(26) << query << std::setw(12) << name << std::right << std::fixed << std::setprecision(3) << std::setw(12) << ms << std::setprecision(1) << std::setw(12) << ms * 1e6 / size << std::setw(10) << referenceHits << "\n";
+            }
+            if (!consistent) {
+                std::cerr << "mismatch: matchers disagree on \"" << query << "\" over " << size << " rows\n";
+                return 1;
+            }
+        }
+        std::cout << "\n";
+    }
+    return 0;
+}
@@ -38,8 +38,25 @@
 #include <thread>
 #include <vector>
 #include <unistd.h>
+#include <unordered_set>
 
 
+// Visited (dev, ino) set shared by the directory walkers of one import
+class VisitedDirectories;
+class ScanProgress;
+class BackgroundThrottle;
+class ImportJournal;
+struct ScanRules;
+
+// Candidates of every image format found by one discovery pass
+struct DiscoveredImages;
+
+// Numbered list over the rows of a sorted catalog, whole or filtered
+class ListView;
+
+// Loop devices set up for one mount batch
+class LoopDevicePool;
+
 // Get max available CPU cores for global use
 extern unsigned int maxThreads;
 
@@ -101,13 +118,15 @@ void getRealUserId(uid_t& real_uid, gid_t& real_gid, std::string& real_username,
 
 // stds
 std::pair<std::string, std::string> extractDirectoryAndFilename(std::string_view path);
+std::vector<std::pair<std::string, std::string>> readConfigPairs(const std::string& filePath);
 
 // voids
 void help();
 void selectForIsoFiles(const std::string& operation, bool& historyPattern, int& maxDepth, bool& verbose);
-void printList(const std::vector<std::string>& items, const std::string& listType);
+void printList(const ListView& items, const std::string& listType, const std::vector<size_t>& indexes = {});
+void printList(const std::vector<std::string>& items, const std::string& listType, const std::vector<size_t>& indexes = {});
 void verbosePrint(const std::set<std::string>& primarySet, const std::set<std::string>& secondarySet , const std::set<std::string>& tertiarySet, const std::set<std::string>& quaternarySet,const std::set<std::string>& errorSet, int printType);
-void tokenizeInput(const std::string& input, std::vector<std::string>& isoFiles, std::set<std::string>& uniqueErrorMessages, std::set<int>& processedIndices);
+void tokenizeInput(const std::string& input, size_t listSize, std::set<std::string>& uniqueErrorMessages, std::set<int>& processedIndices);
 void displayProgressBarWithSize(std::atomic<size_t>* completedBytes, size_t totalBytes, std::atomic<size_t>* completedTasks, size_t totalTasks, std::atomic<bool>* isComplete, bool* verbose);
 
 // size_ts
@@ -119,25 +138,40 @@ size_t getTotalFileSize(const std::vector<std::string>& files);
 // voids
 void loadHistory(bool& historyPattern);
 void saveHistory(bool& historyPattern);
+void recordPathUse(const std::vector<std::string>& paths);
+
+// stds
+std::unordered_map<std::string, double> loadFrecencyScores();
 
 
 // MOUNT
 
+// Filesystem and volume label read from an image's descriptors before it is mounted
+struct VolumeProbe {
+    std::string fsType;   // "iso9660", "udf" or "hfsplus", empty when none was recognised
+    std::string fallbackFsType; // "iso9660" for UDF/ISO 9660 hybrids, tried when the kernel has no udf
+    std::string label;    // ISO 9660 volume identifier without padding
+};
+
 // bools
 bool isAlreadyMounted(const std::string& mountPoint);
 
+// stds
+std::string isoMountPoint(const std::string& isoFile);
+VolumeProbe probeIsoVolume(const std::string& path);
+
 // voids
-void mountIsoFiles(const std::vector<std::string>& isoFiles, std::set<std::string>& mountedFiles, std::set<std::string>& skippedMessages, std::set<std::string>& mountedFails);
-void processAndMountIsoFiles(const std::string& input, std::vector<std::string>& isoFiles, std::set<std::string>& mountedFiles,std::set<std::string>& skippedMessages, std::set<std::string>& mountedFails, std::set<std::string>& uniqueErrorMessages, bool& verbose);
+void mountIsoFiles(const std::vector<std::string>& isoFiles, std::set<std::string>& mountedFiles, std::set<std::string>& skippedMessages, std::set<std::string>& mountedFails, LoopDevicePool* loopPool = nullptr, bool useFsContext = false);
+void processAndMountIsoFiles(const std::string& input, const ListView& isoFiles, std::set<std::string>& mountedFiles,std::set<std::string>& skippedMessages, std::set<std::string>& mountedFails, std::set<std::string>& uniqueErrorMessages, bool& verbose);
 
 
 // UMOUNT
 
 // bools
-bool loadAndDisplayMountedISOs(std::vector<std::string>& isoDirs, std::vector<std::string>& filteredFiles, bool& isFiltered);
+bool loadAndDisplayMountedISOs(std::vector<std::string>& isoDirs, ListView& view);
 
 // voids
-void prepareUnmount(const std::string& input, std::vector<std::string>& selectedIsoDirs, std::vector<std::string>& currentFiles, std::set<std::string>& operationFiles, std::set<std::string>& operationFails, std::set<std::string>& uniqueErrorMessages, bool& umountMvRmBreak, bool& verbose);
+void prepareUnmount(const std::string& input, std::vector<std::string>& selectedIsoDirs, const ListView& currentFiles, std::set<std::string>& operationFiles, std::set<std::string>& operationFails, std::set<std::string>& uniqueErrorMessages, bool& umountMvRmBreak, bool& verbose);
 void unmountISO(const std::vector<std::string>& isoDirs, std::set<std::string>& unmountedFiles, std::set<std::string>& unmountedErrors);
 
 
@@ -145,18 +179,18 @@ void unmountISO(const std::vector<std::string>& isoDirs, std::set<std::string>&
 
 // bools
 bool saveCache(const std::vector<std::string>& isoFiles, std::size_t maxCacheSize);
-bool clearAndLoadFiles(std::vector<std::string>& filteredFiles, bool& isFiltered);
+bool clearAndLoadFiles(ListView& view);
 
 // stds
 std::string getHomeDirectory();
 std::vector<std::string> loadCache();
 
 // voids
-void verboseIsoCacheRefresh(std::vector<std::string>& allIsoFiles, std::atomic<size_t>& totalFiles, std::vector<std::string>& validPaths, std::set<std::string>& invalidPaths, std::set<std::string>& uniqueErrorMessages, bool& promptFlag, int& maxDepth, bool& historyPattern, const std::chrono::high_resolution_clock::time_point& start_time);
+void verboseIsoCacheRefresh(std::atomic<size_t>& totalFiles, std::vector<std::string>& validPaths, std::set<std::string>& invalidPaths, std::set<std::string>& uniqueErrorMessages, bool& promptFlag, int& maxDepth, bool& historyPattern, const std::chrono::high_resolution_clock::time_point& start_time, bool saveSuccess);
 void delCacheAndShowStats (std::string& inputSearch, const bool& promptFlag, const int& maxDepth, const bool& historyPattern);
 void loadCache(std::vector<std::string>& isoFiles);
 void manualRefreshCache(const std::string& initialDir = "", bool promptFlag = true, int maxDepth = -1, bool historyPattern = false);
-void traverse(const std::filesystem::path& path, std::vector<std::string>& isoFiles, std::set<std::string>& uniqueErrorMessages, std::atomic<size_t>& totalFiles, std::mutex& traverseFilesMutex, std::mutex& traverseErrorsMutex, int& maxDepth, bool& promptFlag);
+void traverse(const std::filesystem::path& path, std::vector<std::string>& isoFiles, std::set<std::string>& uniqueErrorMessages, ScanProgress& progress, std::mutex& traverseFilesMutex, std::mutex& traverseErrorsMutex, int& maxDepth, bool& promptFlag, const ScanRules& rules, VisitedDirectories* visited = nullptr, DiscoveredImages* discovered = nullptr, BackgroundThrottle* throttle = nullptr, ImportJournal* journal = nullptr);
 void backgroundCacheImport(int maxDepthParam, std::atomic<bool>& isImportRunning);
 void removeNonExistentPathsFromCache();
 
@@ -164,18 +198,25 @@ void removeNonExistentPathsFromCache();
 //	CP&MV&RM
 
 // stds
-std::string userDestDirRm(std::vector<std::string>& isoFiles, std::vector<std::vector<int>>& indexChunks, std::string& userDestDir, std::string& operationColor, std::string& operationDescription, bool& umountMvRmBreak, bool& historyPattern, bool& isDelete, bool& isCopy, bool& abortDel);
+std::string userDestDirRm(const ListView& isoFiles, std::vector<std::vector<int>>& indexChunks, std::string& userDestDir, std::string& operationColor, std::string& operationDescription, bool& umountMvRmBreak, bool& historyPattern, bool& isDelete, bool& isCopy, bool& abortDel);
 
 //	voids
-void processOperationInput(const std::string& input, std::vector<std::string>& isoFiles, const std::string& process, std::set<std::string>& operationIsos, std::set<std::string>& operationErrors, std::set<std::string>& uniqueErrorMessages, bool& promptFlag, int& maxDepth, bool& umountMvRmBreak, bool& historyPattern, bool& verbose);
-void handleIsoFileOperation(const std::vector<std::string>& isoFiles, std::vector<std::string>& isoFilesCopy, std::set<std::string>& operationIsos, std::set<std::string>& operationErrors, const std::string& userDestDir, bool isMove, bool isCopy, bool isDelete, std::atomic<size_t>* completedBytes, std::atomic<size_t>* completedTasks);
+void processOperationInput(const std::string& input, const ListView& isoFiles, const std::string& process, std::set<std::string>& operationIsos, std::set<std::string>& operationErrors, std::set<std::string>& uniqueErrorMessages, bool& promptFlag, int& maxDepth, bool& umountMvRmBreak, bool& historyPattern, bool& verbose);
+void handleIsoFileOperation(const std::vector<std::string>& isoFiles, const ListView& isoFilesCopy, std::set<std::string>& operationIsos, std::set<std::string>& operationErrors, const std::string& userDestDir, bool isMove, bool isCopy, bool isDelete, std::atomic<size_t>* completedBytes, std::atomic<size_t>* completedTasks);
 
 // FILTER
 
+// bools
+bool isFuzzyQuery(const std::string& query);
+
 // stds
 std::string removeAnsiCodes(const std::string& input);
 std::vector<size_t> boyerMooreSearch(const std::string& pattern, const std::string& text);
 std::vector<std::string> filterFiles(const std::vector<std::string>& files, const std::string& query);
+std::vector<uint32_t> filterRows(const ListView& view, const std::string& query);
+
+// chars
+char* readLiveFilterQuery(const std::string& prompt, const ListView& view, const std::string& listType, bool& pageShown);
 
 // voids
 void toLowerInPlace(std::string& str);
@@ -185,9 +226,11 @@ void toLowerInPlace(std::string& str);
 
 // bools
 bool blacklist(const std::filesystem::path& entry, const bool& blacklistMdf, const bool& blacklistNrg);
+bool saveImageCatalog(const std::string& mode, const std::vector<std::string>& files);
 
 // stds
-std::set<std::string> processBatchPaths(const std::vector<std::string>& batchPaths, const std::string& mode, const std::function<void(const std::string&, const std::string&)>& callback,std::set<std::string>& processedErrorsFind);
+std::set<std::string> processBatchPaths(const std::vector<std::string>& batchPaths, const std::string& mode, const std::function<void(const std::string&, const std::string&)>& callback,std::set<std::string>& processedErrorsFind, VisitedDirectories* visited = nullptr, DiscoveredImages* discovered = nullptr, ScanProgress* progress = nullptr);
+std::vector<std::string> loadImageCatalog(const std::string& mode);
 std::vector<std::string> findFiles(const std::vector<std::string>& inputPaths, std::set<std::string>& fileNames, int& currentCacheOld, const std::string& mode, const std::function<void(const std::string&, const std::string&)>& callback, const std::vector<std::string>& directoryPaths, std::set<std::string>& invalidDirectoryPaths, std::set<std::string>& processedErrorsFind);
 
 // voids
@@ -1,6 +1,9 @@
 // SPDX-License-Identifier: GNU General Public License v3.0 or later
 
 #include "../headers.h"
+#include "../scan.h"
+#include "../metaio.h"
+#include "../search.h"
 
 
 // Cache Variables
@@ -10,6 +13,12 @@ const std::string cacheFilePath = std::string(getenv("HOME")) + "/.local/share/i
 const std::string cacheFileName = "iso_commander_cache.txt";
 const uintmax_t maxCacheSize = 10 * 1024 * 1024; // 10MB
 
+// How often AutoImportISO and traverse hand partial results on
+static constexpr std::chrono::milliseconds PUBLISH_INTERVAL{250};
+
+// Serializes every write to the ISO cache file within the process, flock covers other processes
+static std::mutex saveCacheMutex;
+
 
 // Function to remove non-existent paths from cache
 void removeNonExistentPathsFromCache() {
@@ -17,6 +26,7 @@ void removeNonExistentPathsFromCache() {
 	if (!std::filesystem::exists(cacheFilePath)) {
         // If the file is missing, clear the ISO cache and return
         globalIsoFileList.clear();
+        globalIsoSearchIndex.clear();
         return;
     }
 
@@ -65,33 +75,14 @@ void removeNonExistentPathsFromCache() {
     flock(fd, LOCK_UN);
     close(fd);
 
-    // Determine batch size
-    const size_t maxThreads = std::thread::hardware_concurrency();
-    const size_t batchSize = std::max(cache.size() / maxThreads + 1, static_cast<size_t>(2));
-
-    // Create a vector to hold futures
-    std::vector<std::future<std::vector<std::string>>> futures;
-
-    // Process paths in batches
-    for (size_t i = 0; i < cache.size(); i += batchSize) {
-        auto begin = cache.begin() + i;
-        auto end = std::min(begin + batchSize, cache.end());
-            futures.push_back(std::async(std::launch::async, [begin, end]() {
-            std::vector<std::string> result;
-            for (auto it = begin; it != end; ++it) {
-                if (std::filesystem::exists(*it)) {
-                    result.push_back(*it);
-                }
-            }
-            return result;
-        }));
-    }
-
-    // Collect results
+    // All paths are checked in one batch, io_uring keeps many stats in flight on slow storage
+    std::vector<PathStat> stats = statPaths(cache);
     std::vector<std::string> retainedPaths;
-    for (auto& future : futures) {
-        auto result = future.get();
-        retainedPaths.insert(retainedPaths.end(), std::make_move_iterator(result.begin()), std::make_move_iterator(result.end()));
+    for (size_t i = 0; i < cache.size(); ++i) {
+        // Only paths that are gone are dropped, unreadable or unreachable ones (EACCES, EIO, a stale NFS handle) are kept
+        if (stats[i].error != ENOENT && stats[i].error != ENOTDIR) {
+            retainedPaths.push_back(std::move(cache[i]));
+        }
     }
 
     // Open the cache file for writing
@@ -115,9 +106,7 @@ void removeNonExistentPathsFromCache() {
     }
 
     for (const std::string& path : retainedPaths) {
-		if (std::filesystem::exists(path)) {
-			updatedCacheFile << path << '\n';
-		}
+		updatedCacheFile << path << '\n';
 	}
 
     // RAII: Close the file and release the lock
@@ -159,7 +148,7 @@ std::string getHomeDirectory() {
 
 
 // Utility function to clear screen buffer and load IsoFiles from cache to a global vector only for the first time and only for if the cache has been modified.
-bool clearAndLoadFiles(std::vector<std::string>& filteredFiles, bool& isFiltered) {
+bool clearAndLoadFiles(ListView& view) {
     static std::filesystem::file_time_type lastModifiedTime;
 
     clearScrollBuffer();
@@ -186,12 +175,25 @@ bool clearAndLoadFiles(std::vector<std::string>& filteredFiles, bool& isFiltered
     }
 
     if (needToReload) {
+        // A filtered view finds its paths again in the reloaded list
+        std::vector<std::string> shownPaths;
+        if (view.isFiltered()) shownPaths = view.paths();
+
         removeNonExistentPathsFromCache();
         loadCache(globalIsoFileList);
         sortFilesCaseInsensitive(globalIsoFileList);
+        FilterRules filterRules = loadFilterRules();
+        globalIsoSearchIndex.setStripMarks(filterRules.ignoreAccents);
+        if (filterRules.trigramIndex) {
+            globalIsoSearchIndex.enableTrigrams(maxThreads);
+        } else {
+            globalIsoSearchIndex.disableTrigrams();
+        }
+        globalIsoSearchIndex.sync(globalIsoFileList);
+        view.restorePaths(shownPaths);
     }
 
-    printList(isFiltered ? filteredFiles : globalIsoFileList, "ISO_FILES");
+    printList(view, "ISO_FILES");
 
     if (globalIsoFileList.empty()) {
         clearScrollBuffer();
@@ -205,11 +207,58 @@ bool clearAndLoadFiles(std::vector<std::string>& filteredFiles, bool& isFiltered
 }
 
 
+// Function to append ISOs the cache file does not list yet, without re-reading and rewriting the whole file.
+// The lines stay unsorted until the next saveCache, loadCache sorts and deduplicates them anyway.
+static bool appendToCache(const std::vector<std::string>& isoFiles, std::unordered_set<std::string>& cachedIsoFiles) {
+    std::string lines;
+    for (const std::string& iso : isoFiles) {
+        if (cachedIsoFiles.insert(iso).second) {
+            lines += iso;
+            lines += '\n';
+        }
+    }
+    if (lines.empty()) return true;
+
+    std::lock_guard<std::mutex> saveLock(saveCacheMutex);
+    std::filesystem::path cachePath = cacheDirectory;
+    cachePath /= cacheFileName;
+    std::error_code error;
+    std::filesystem::create_directories(cacheDirectory, error);
+
+    int fd = open(cachePath.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1) return false;
+    if (flock(fd, LOCK_EX) == -1) {
+        close(fd);
+        return false;
+    }
+
+    // A full cache is left for the final saveCache to trim
+    struct stat cacheStat;
+    bool written = fstat(fd, &cacheStat) == 0 && static_cast<uintmax_t>(cacheStat.st_size) + lines.size() <= maxCacheSize;
+    for (size_t offset = 0; written && offset < lines.size();) {
+        ssize_t result = write(fd, lines.data() + offset, lines.size() - offset);
+        if (result < 0 && errno == EINTR) continue;
+        written = result > 0;
+        if (written) offset += static_cast<size_t>(result);
+    }
+
+    flock(fd, LOCK_UN);
+    close(fd);
+    return written;
+}
+
+
 // Function to auto-import ISO files in cache without blocking the UI
 void backgroundCacheImport(int maxDepthParam, std::atomic<bool>& isImportRunning) {
     std::vector<std::string> paths;
+    std::unordered_map<std::string, size_t> historyRecency;
     int localMaxDepth = maxDepthParam;
     bool localPromptFlag = false;
+
+    // Stay out of the way of the interactive session, the traverse threads inherit this
+    ScanRules rules = loadScanRules();
+    lowerBackgroundPriority(rules);
+    BackgroundThrottle throttle(rules);
     const size_t maxThreadsX2 = (std::thread::hardware_concurrency() == 0 ? 4 : std::thread::hardware_concurrency()) * 2;
 
     // Local condition variable and mutex
@@ -226,7 +275,9 @@ void backgroundCacheImport(int maxDepthParam, std::atomic<bool>& isImportRunning
         }
 
         std::string line;
+        size_t lineNumber = 0;
         while (std::getline(file, line)) {
+            ++lineNumber;
             std::istringstream iss(line);
             std::string path;
             while (std::getline(iss, path, ';')) {
@@ -237,6 +288,7 @@ void backgroundCacheImport(int maxDepthParam, std::atomic<bool>& isImportRunning
                     if (std::find(paths.begin(), paths.end(), path) == paths.end()) {
                         paths.push_back(path);
                     }
+                    historyRecency[path] = lineNumber; // Later lines are more recent
                 }
             }
         }
@@ -257,8 +309,9 @@ void backgroundCacheImport(int maxDepthParam, std::atomic<bool>& isImportRunning
     std::vector<std::string> finalPaths;
     for (const auto& path : paths) {
         bool isSubdir = false;
+        // Unlimited walks keep nested roots, the shared visited set stops the parent from walking them twice
         for (const auto& existingPath : finalPaths) {
-            if (path.size() >= existingPath.size() &&
+            if (localMaxDepth >= 0 && path.size() >= existingPath.size() &&
                 path.compare(0, existingPath.size(), existingPath) == 0 &&
                 (existingPath.back() == '/' || path[existingPath.size()] == '/')) {
                 isSubdir = true;
@@ -270,16 +323,53 @@ void backgroundCacheImport(int maxDepthParam, std::atomic<bool>& isImportRunning
         }
     }
 
+    // Folders the user imports from most often and most recently are walked first
+    std::unordered_map<std::string, double> frecency = loadFrecencyScores();
+    std::stable_sort(finalPaths.begin(), finalPaths.end(), [&](const std::string& a, const std::string& b) {
+        double scoreA = frecency.count(a) ? frecency[a] : 0.0;
+        double scoreB = frecency.count(b) ? frecency[b] : 0.0;
+        if (scoreA != scoreB) return scoreA > scoreB;
+        return historyRecency[a] > historyRecency[b];
+    });
+
     // Process paths with thread limit
     std::vector<std::string> allIsoFiles;
-    std::atomic<size_t> totalFiles{0};
+    ScanProgress progress; // Counted only, nothing is rendered in the background
     std::set<std::string> uniqueErrorMessages;
     std::mutex processMutex;
     std::mutex traverseErrorMutex;
+    VisitedDirectories visited; // Catches bind mounts and symlinked roots the prefix check misses
+    DiscoveredImages discovered; // BIN/IMG, MDF and NRG candidates found on the way
+    std::vector<std::string> walkedPaths;
+
+    // Publish ISOs as they are found, so the list fills in while the slow roots are still walked
+    bool importDone = false;
+    std::mutex publishMutex;
+    std::condition_variable publishCv;
+    std::thread publisher([&]() {
+        size_t published = 0;
+        std::vector<std::string> cached;
+        loadCache(cached);
+        std::unordered_set<std::string> cachedIsoFiles(cached.begin(), cached.end());
+        cached.clear();
+        std::unique_lock<std::mutex> publishLock(publishMutex);
+        while (!publishCv.wait_for(publishLock, PUBLISH_INTERVAL, [&]() { return importDone; })) {
+            std::vector<std::string> fresh;
+            {
+                std::lock_guard<std::mutex> lock(processMutex);
+                fresh.assign(allIsoFiles.begin() + published, allIsoFiles.end());
+                published = allIsoFiles.size();
+            }
+            if (!fresh.empty()) {
+                appendToCache(fresh, cachedIsoFiles); // Only new lines per tick, the full merge runs once at the end
+            }
+        }
+    });
 
     std::vector<std::future<void>> futures;
     for (const auto& path : finalPaths) {
         if (isValidDirectory(path)) {
+            walkedPaths.push_back(path);
             // Wait until the number of active threads is less than maxThreads * 2
             std::unique_lock<std::mutex> lock(threadMutex);
             cv.wait(lock, [&]() { return activeThreads < maxThreadsX2; });
@@ -290,8 +380,8 @@ void backgroundCacheImport(int maxDepthParam, std::atomic<bool>& isImportRunning
             // Launch the task asynchronously
             futures.push_back(std::async(std::launch::async, [&, path]() {
                 traverse(path, allIsoFiles, uniqueErrorMessages,
-                         totalFiles, processMutex, traverseErrorMutex,
-                         localMaxDepth, localPromptFlag);
+                         progress, processMutex, traverseErrorMutex,
+                         localMaxDepth, localPromptFlag, rules, &visited, &discovered, &throttle);
 
                 // Decrement the active thread count when done
                 {
@@ -310,7 +400,15 @@ void backgroundCacheImport(int maxDepthParam, std::atomic<bool>& isImportRunning
         future.wait();
     }
 
+    {
+        std::lock_guard<std::mutex> lock(publishMutex);
+        importDone = true;
+    }
+    publishCv.notify_one();
+    publisher.join();
+
     saveCache(allIsoFiles, maxCacheSize);
+    publishDiscoveredImages(discovered, localMaxDepth < 0 ? walkedPaths : std::vector<std::string>{}, "iso");
 
     isImportRunning.store(false);
 }
@@ -373,6 +471,9 @@ void loadCache(std::vector<std::string>& isoFiles) {
 
 // Function to save ISO cache to file
 bool saveCache(const std::vector<std::string>& isoFiles, std::size_t maxCacheSize) {
+    // The background publisher and foreground refreshes must not interleave their writes
+    std::lock_guard<std::mutex> saveLock(saveCacheMutex);
+
     std::filesystem::path cachePath = cacheDirectory;
     cachePath /= cacheFileName;
 
@@ -553,6 +654,10 @@ void manualRefreshCache(const std::string& initialDir, bool promptFlag, int maxD
     std::vector<std::future<void>> futures;
     std::mutex processMutex;
     std::mutex traverseErrorMutex;
+    ScanProgress progress; // Workers count, one render thread prints
+    VisitedDirectories visited; // Overlapping paths, bind mounts and symlinks are walked once
+    DiscoveredImages discovered; // BIN/IMG, MDF and NRG candidates found on the way
+    std::vector<std::string> walkedPaths;
 
     std::istringstream iss(input);
     std::string path;
@@ -570,10 +675,36 @@ void manualRefreshCache(const std::string& initialDir, bool promptFlag, int maxD
         }
 
         validPaths.push_back(path);
+
+        // A Convert2ISO search of this folder already stored its ISOs, no need to walk it again
+        if (promptFlag && maxDepth < 0 && consumeDiscoveredRoot(path, "iso")) {
+            continue;
+        }
+
+        walkedPaths.push_back(path);
+    }
+
+    const ScanRules rules = loadScanRules(); // Read once, shared by every root of this import and its journal
+
+    // Interactive imports are journaled, rerunning an interrupted one skips the folders it finished
+    std::unique_ptr<ImportJournal> journal;
+    if (promptFlag && !walkedPaths.empty()) {
+        journal = std::make_unique<ImportJournal>(walkedPaths, maxDepth, rules);
+        const std::vector<std::string>& recovered = journal->recoveredIsoFiles();
+        allIsoFiles.insert(allIsoFiles.end(), recovered.begin(), recovered.end());
+        if (journal->resumed()) {
+            std::cout << "\033[0;1mResuming interrupted import: \033[1;92m" << recovered.size() << "\033[0;1m ISO files recovered, \033[1;92m"
+                      << journal->completedCount() << "\033[0;1m finished folders skipped.\n";
+        }
+        progress.start();
+    }
+
+    for (const auto& walkedPath : walkedPaths) {
+        ImportJournal* journalPtr = journal.get();
         futures.emplace_back(std::async(std::launch::async, 
-            [path, &allIsoFiles, &uniqueErrorMessages, &totalFiles, &processMutex, &traverseErrorMutex, &maxDepth, &promptFlag]() {
-                traverse(path, allIsoFiles, uniqueErrorMessages, 
-                         totalFiles, processMutex, traverseErrorMutex, maxDepth, promptFlag);
+            [walkedPath, &allIsoFiles, &uniqueErrorMessages, &progress, &processMutex, &traverseErrorMutex, &maxDepth, &promptFlag, &rules, &visited, &discovered, journalPtr]() {
+                traverse(walkedPath, allIsoFiles, uniqueErrorMessages, 
+                         progress, processMutex, traverseErrorMutex, maxDepth, promptFlag, rules, &visited, &discovered, nullptr, journalPtr);
             }
         ));
 
@@ -590,6 +721,17 @@ void manualRefreshCache(const std::string& initialDir, bool promptFlag, int maxD
     for (auto& future : futures) {
         future.wait();
     }
+    progress.stop();
+    totalFiles = progress.total();
+
+    // Only complete walks mark their folders as fresh for the Convert2ISO modes
+    publishDiscoveredImages(discovered, maxDepth < 0 ? walkedPaths : std::vector<std::string>{}, "iso");
+
+    // Save the combined cache to disk, the journal is only dropped once its ISOs are safe
+    bool saveSuccess = saveCache(allIsoFiles, maxCacheSize);
+    if (saveSuccess && journal) {
+        journal->finish();
+    }
     
     // Post-processing
     if (promptFlag) {
@@ -608,12 +750,11 @@ void manualRefreshCache(const std::string& initialDir, bool promptFlag, int maxD
 		if (!validPaths.empty() && !input.empty()) {
 			saveHistory(historyPattern);
 			clear_history();
+			recordPathUse(validPaths);
 		}
-        verboseIsoCacheRefresh(allIsoFiles, totalFiles, validPaths, invalidPaths, 
-                               uniqueErrorMessages, promptFlag, maxDepth, historyPattern, start_time);
+        verboseIsoCacheRefresh(totalFiles, validPaths, invalidPaths, 
+                               uniqueErrorMessages, promptFlag, maxDepth, historyPattern, start_time, saveSuccess);
     } else {
-		// Save the combined cache to disk
-		saveCache(allIsoFiles, maxCacheSize);
 		promptFlag = true;
 		maxDepth = -1;
 	}
@@ -621,77 +762,79 @@ void manualRefreshCache(const std::string& initialDir, bool promptFlag, int maxD
 
 
 // Function to traverse a directory and find ISO files
-void traverse(const std::filesystem::path& path, std::vector<std::string>& isoFiles, std::set<std::string>& uniqueErrorMessages, std::atomic<size_t>& totalFiles, std::mutex& traverseFilesMutex, std::mutex& traverseErrorsMutex, int& maxDepth, bool& promptFlag) {
+void traverse(const std::filesystem::path& path, std::vector<std::string>& isoFiles, std::set<std::string>& uniqueErrorMessages, ScanProgress& progress, std::mutex& traverseFilesMutex, std::mutex& traverseErrorsMutex, int& maxDepth, bool& promptFlag, const ScanRules& rules, VisitedDirectories* visited, DiscoveredImages* discovered, BackgroundThrottle* throttle, ImportJournal* journal) {
     const size_t BATCH_SIZE = 100;
     std::vector<std::string> localIsoFiles;
     std::vector<std::string> localErrors;
-
-    auto iequals = [](const std::string_view& a, const std::string_view& b) {
-        return std::equal(a.begin(), a.end(), b.begin(), b.end(),
-                         [](unsigned char a, unsigned char b) {
-                             return std::tolower(a) == std::tolower(b);
-                         });
+    std::vector<std::string> localBinImg, localMdf, localNrg; // Other formats for the discovery catalogs
+
+    ScanProgress::Slot& processed = progress.acquireSlot(); // This walker's own counter, drawn by the render thread
+    auto lastFlush = std::chrono::steady_clock::now();
+    auto flushIsoFiles = [&]() {
+        std::lock_guard<std::mutex> lock(traverseFilesMutex);
+        isoFiles.insert(isoFiles.end(), localIsoFiles.begin(), localIsoFiles.end());
+        localIsoFiles.clear();
+        lastFlush = std::chrono::steady_clock::now();
     };
 
-    try {
-        auto options = std::filesystem::directory_options::none;
-        for (auto it = std::filesystem::recursive_directory_iterator(path, options); 
-             it != std::filesystem::recursive_directory_iterator(); ++it) {
-            try {
-                if (maxDepth >= 0 && it.depth() > maxDepth) {
-                    it.disable_recursion_pending();
-                    continue;
-                }
+    DirectoryWalker walker(maxDepth, rules, [&](std::string_view name, const std::string& fullPath) {
+        size_t count = processed.count.fetch_add(1, std::memory_order_relaxed) + 1;
 
-                const auto& entry = *it;
-                if (promptFlag && entry.is_regular_file()) {
-                    totalFiles++;  // Simple increment of atomic counter
-                    if (totalFiles % 100 == 0) {  // Update display periodically
-                        std::cout << "\r\033[0;1mTotal files processed: " << totalFiles << std::flush;
-                    }
-                }
-
-                if (!entry.is_regular_file()) continue;
-
-                const auto& filePath = entry.path();
-                if (!iequals(filePath.extension().string(), ".iso")) continue;
+        // Sparse ISO finds in a large tree still reach the publisher on time, the clock is read every 64 files
+        if (!localIsoFiles.empty() && count % 64 == 0 && std::chrono::steady_clock::now() - lastFlush >= PUBLISH_INTERVAL) {
+            flushIsoFiles();
+        }
 
-                localIsoFiles.push_back(filePath.string());
+        // Suffix check on the raw name bytes, no path or extension objects needed
+        ImageKind kind = classifyImageName(name);
+        if (kind == ImageKind::None || (kind != ImageKind::Iso && !discovered)) return;
+        if (rules.magicProbe && !matchesImageMagic(fullPath, kind)) return;
 
-                if (localIsoFiles.size() >= BATCH_SIZE) {
-                    std::lock_guard<std::mutex> lock(traverseFilesMutex);
-                    isoFiles.insert(isoFiles.end(), localIsoFiles.begin(), localIsoFiles.end());
-                    localIsoFiles.clear();
-                }
-            } catch (const std::filesystem::filesystem_error& entryError) {
-                localErrors.push_back("\n\033[1;91mError processing path: " + 
-                                    it->path().string() + " - " + 
-                                    entryError.what() + "\033[0;1m");
+        if (kind != ImageKind::Iso) {
+            auto& bucket = (kind == ImageKind::BinImg) ? localBinImg : (kind == ImageKind::Mdf) ? localMdf : localNrg;
+            bucket.push_back(fullPath);
+            if (bucket.size() >= BATCH_SIZE) {
+                discovered->append(kind, bucket);
             }
+            return;
         }
 
-        // Update display one final time if needed
-        if (promptFlag && totalFiles == 0) {
-            std::cout << "\r\033[0;1mTotal files processed: " << totalFiles << std::flush;
+        if (rules.canonicalPaths) {
+            // Symlinked and bind-mounted copies collapse to one cache entry
+            std::unique_ptr<char, decltype(&std::free)> resolved(realpath(fullPath.c_str(), nullptr), &std::free);
+            localIsoFiles.push_back(resolved ? std::string(resolved.get()) : fullPath);
+        } else {
+            localIsoFiles.push_back(fullPath);
         }
-
-        // Merge leftovers
-        if (!localIsoFiles.empty()) {
-            std::lock_guard<std::mutex> lock(traverseFilesMutex);
-            isoFiles.insert(isoFiles.end(), localIsoFiles.begin(), localIsoFiles.end());
+        if (journal) {
+            journal->recordIso(localIsoFiles.back()); // Journaled before its folder can be marked finished
         }
 
-        // Merge errors
-        if (!localErrors.empty() && promptFlag) {
-            std::lock_guard<std::mutex> errorLock(traverseErrorsMutex);
-            uniqueErrorMessages.insert(localErrors.begin(), localErrors.end());
+        if (localIsoFiles.size() >= BATCH_SIZE || std::chrono::steady_clock::now() - lastFlush >= PUBLISH_INTERVAL) {
+            flushIsoFiles();
         }
-    } catch (const std::filesystem::filesystem_error& e) {
-        std::string formattedError = "\n\033[1;91mError traversing directory: " + 
-                                    path.string() + " - " + e.what() + "\033[0;1m";
-        if (promptFlag) {
-            std::lock_guard<std::mutex> errorLock(traverseErrorsMutex);
-            uniqueErrorMessages.insert(formattedError);
+    }, localErrors, visited);
+    walker.setThrottle(throttle);
+    walker.setJournal(journal);
+
+    walker.walk(path.string());
+
+    // Merge leftovers
+    if (!localIsoFiles.empty()) {
+        std::lock_guard<std::mutex> lock(traverseFilesMutex);
+        isoFiles.insert(isoFiles.end(), localIsoFiles.begin(), localIsoFiles.end());
+    }
+    if (discovered) {
+        discovered->append(ImageKind::BinImg, localBinImg);
+        discovered->append(ImageKind::Mdf, localMdf);
+        discovered->append(ImageKind::Nrg, localNrg);
+    }
+
+    // Merge errors
+    if (!localErrors.empty() && promptFlag) {
+        std::lock_guard<std::mutex> errorLock(traverseErrorsMutex);
+        for (const auto& error : localErrors) {
+            uniqueErrorMessages.insert("\n\033[1;91mError traversing directory: " + error + "\033[0;1m");
         }
     }
 }
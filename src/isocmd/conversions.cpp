@@ -2,14 +2,112 @@
 
 #include "../headers.h"
 #include "../threadpool.h"
+#include "../scan.h"
 #include "../mdf.h"
 #include "../ccd.h"
+#include "../search.h"
 
 
 static std::vector<std::string> binImgFilesCache; // Memory cached binImgFiles here
 static std::vector<std::string> mdfMdsFilesCache; // Memory cached mdfImgFiles here
 static std::vector<std::string> nrgFilesCache; // Memory cached nrgImgFiles here
 
+// On-disk catalogs backing the RAM caches, filled by every discovery pass
+const std::string imageCatalogDirectory = std::string(getenv("HOME")) + "/.local/share/isocmd/database/";
+
+
+// Function to get the RAM cache and on-disk catalog path for a conversion mode
+static std::vector<std::string>* ramCacheForMode(const std::string& mode) {
+    if (mode == "bin") return &binImgFilesCache;
+    if (mode == "mdf") return &mdfMdsFilesCache;
+    if (mode == "nrg") return &nrgFilesCache;
+    return nullptr;
+}
+
+static std::string imageCatalogPath(const std::string& mode) {
+    return imageCatalogDirectory + "iso_commander_" + mode + "_cache.txt";
+}
+
+
+// Function to load an image catalog, entries that no longer exist are dropped
+std::vector<std::string> loadImageCatalog(const std::string& mode) {
+    std::vector<std::string> files;
+    int fd = open(imageCatalogPath(mode).c_str(), O_RDONLY);
+    if (fd == -1) {
+        return files;
+    }
+
+    if (flock(fd, LOCK_SH) == -1) {
+        close(fd);
+        return files;
+    }
+
+    std::ifstream catalogFile(imageCatalogPath(mode));
+    std::string line;
+    while (std::getline(catalogFile, line)) {
+        struct stat st;
+        if (!line.empty() && stat(line.c_str(), &st) == 0) {
+            files.push_back(std::move(line));
+        }
+    }
+
+    flock(fd, LOCK_UN);
+    close(fd);
+    return files;
+}
+
+
+// Function to merge files into an image catalog on disk
+bool saveImageCatalog(const std::string& mode, const std::vector<std::string>& files) {
+    if (!std::filesystem::exists(imageCatalogDirectory) && !std::filesystem::create_directories(imageCatalogDirectory)) {
+        return false;
+    }
+
+    std::vector<std::string> existing = loadImageCatalog(mode);
+    std::set<std::string> combined(existing.begin(), existing.end());
+    combined.insert(files.begin(), files.end());
+
+    int fd = open(imageCatalogPath(mode).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        return false;
+    }
+
+    if (flock(fd, LOCK_EX) == -1) {
+        close(fd);
+        return false;
+    }
+
+    std::ofstream catalogFile(imageCatalogPath(mode), std::ios::out | std::ios::trunc);
+    for (const std::string& file : combined) {
+        catalogFile << file << "\n";
+    }
+    bool success = catalogFile.good();
+    catalogFile.close();
+
+    flock(fd, LOCK_UN);
+    close(fd);
+    return success;
+}
+
+
+// Entries the last mergeImageCatalog of each mode added to its RAM cache, the only ones a catalog-served search reports as new
+static std::unordered_map<std::string, std::unordered_set<std::string>> mergedCatalogEntries;
+
+
+// Function to pull entries found by other modes' passes into the RAM cache
+static void mergeImageCatalog(const std::string& mode) {
+    std::vector<std::string>* ramCache = ramCacheForMode(mode);
+    std::unordered_set<std::string>& merged = mergedCatalogEntries[mode];
+    merged.clear();
+    std::set<std::string> known(ramCache->begin(), ramCache->end());
+    for (auto& file : loadImageCatalog(mode)) {
+        if (known.insert(file).second) {
+            merged.insert(file);
+            ramCache->push_back(std::move(file));
+        }
+    }
+}
+
 
 // Function to clear Ram Cache and memory transformations for bin/img mdf nrg files
 void clearRamCache (bool& modeMdf, bool& modeNrg) {
@@ -20,14 +118,17 @@ void clearRamCache (bool& modeMdf, bool& modeNrg) {
     if (!modeMdf && !modeNrg) {
         extensions = {".bin", ".img"};
         binImgFilesCache.clear();
+        std::remove(imageCatalogPath("bin").c_str());
         cacheType = "BIN/IMG";
     } else if (modeMdf) {
         extensions = {".mdf"};
         mdfMdsFilesCache.clear();
+        std::remove(imageCatalogPath("mdf").c_str());
         cacheType = "MDF";
     } else if (modeNrg) {
         extensions = {".nrg"};
         nrgFilesCache.clear();
+        std::remove(imageCatalogPath("nrg").c_str());
         cacheType = "NRG";
     }
 
@@ -110,6 +211,8 @@ void promptSearchBinImgMdfNrg(const std::string& fileTypeChoice, bool& promptFla
         fileNames.clear();
         processedErrorsFind.clear();
 
+        // Pick up entries found by ImportISO or the other conversion modes
+        mergeImageCatalog(fileType == "img" ? "bin" : fileType);
 
         // Manage command history
         clear_history();
@@ -246,6 +349,7 @@ void select_and_convert_to_iso(const std::string& fileType, std::vector<std::str
     std::set<std::string> processedErrors, successOuts, skippedOuts, failedOuts, deletedOuts;
     
     bool isFiltered = false; // Indicates if the file list is currently filtered
+    bool isRanked = false; // A fuzzy filter left the list ranked best first, it is not re-sorted
     bool needsScrnClr = true;
     std::string fileExtension = (fileType == "bin" || fileType == "img") ? ".bin/.img" 
                                    : (fileType == "mdf") ? ".mdf" : ".nrg"; // Determine file extension based on type
@@ -260,20 +364,21 @@ void select_and_convert_to_iso(const std::string& fileType, std::vector<std::str
 	}
     
     // Lambda function for filtering the file list
-    auto filterQuery = [&files, &historyPattern, &fileType, &filterPrompt, &needsScrnClr]() {
+    auto filterQuery = [&files, &historyPattern, &fileType, &filterPrompt, &needsScrnClr, &isRanked]() {
         while (true) {
             clear_history(); // Clear the input history
             historyPattern = true;
             loadHistory(historyPattern); // Load input history if available
 
-            // Prompt the user for a search query
-            std::unique_ptr<char, decltype(&std::free)> rawSearchQuery(readline(filterPrompt.c_str()), &std::free);
+            // Prompt the user for a search query, matches are shown while typing
+            bool pageShown = false;
+            std::unique_ptr<char, decltype(&std::free)> rawSearchQuery(readLiveFilterQuery(filterPrompt, ListView(files), "IMAGE_FILES", pageShown), &std::free);
             std::string inputSearch(rawSearchQuery.get());
 
             // Exit the filter loop if input is empty or "/"
             if (inputSearch.empty() || inputSearch == "/") {
-				std::cout << "\033[2A\033[K";
-				needsScrnClr = false;
+				if (!pageShown) std::cout << "\033[2A\033[K";
+				needsScrnClr = pageShown;
 				break;
 			}
 
@@ -281,8 +386,8 @@ void select_and_convert_to_iso(const std::string& fileType, std::vector<std::str
             auto filteredFiles = filterFiles(files, inputSearch);
             if (filteredFiles.empty()) continue; // Skip if no files match the filter
             if (filteredFiles.size() == files.size()) {
-				std::cout << "\033[2A\033[K";
-				needsScrnClr = false;
+				if (!pageShown) std::cout << "\033[2A\033[K";
+				needsScrnClr = pageShown;
 				break;
 			}
 
@@ -292,6 +397,7 @@ void select_and_convert_to_iso(const std::string& fileType, std::vector<std::str
             historyPattern = false;
             clear_history(); // Clear history to reset for future inputs
             files = filteredFiles; // Update the file list with the filtered results
+            isRanked = isFuzzyQuery(inputSearch);
             needsScrnClr = true;
             break;
         }
@@ -316,7 +422,7 @@ void select_and_convert_to_iso(const std::string& fileType, std::vector<std::str
 		} else if ((fileType == "nrg") && (nrgFilesCache.size() != files.size()) && !nrgFilesCache.empty()  && !isFiltered) {
 			files = nrgFilesCache;
 		}
-        sortFilesCaseInsensitive(files); // Sort the files case-insensitively
+        if (!isRanked) sortFilesCaseInsensitive(files); // Sort the files case-insensitively
         printList(files, "IMAGE_FILES"); // Print the current list of files
 		}
 		std::cout << "\n\n";
@@ -353,6 +459,7 @@ void select_and_convert_to_iso(const std::string& fileType, std::vector<std::str
                         (fileType == "mdf" ? mdfMdsFilesCache : nrgFilesCache);
                 needsScrnClr = true;
                 isFiltered = false; // Reset filter status
+                isRanked = false;
                 continue;
             } else {
                 break; // Exit the loop if no input
@@ -383,7 +490,7 @@ void processInput(const std::string& input, std::vector<std::string>& fileList,
     std::string concatenatedFilePaths;
 
     std::set<int> processedIndices;
-    tokenizeInput(input, fileList, processedErrors, processedIndices);
+    tokenizeInput(input, fileList.size(), processedErrors, processedIndices);
     
     if (processedIndices.empty()) {
         clearScrollBuffer();
@@ -459,6 +566,8 @@ void processInput(const std::string& input, std::vector<std::string>& fileList,
         }
     }
 
+    ForegroundActivity foreground; // AutoImportISO pauses until the conversions are done
+
     std::atomic<size_t> completedBytes(0);
     std::atomic<size_t> completedTasks(0);
     std::atomic<bool> isProcessingComplete(false);
@@ -502,60 +611,78 @@ void processInput(const std::string& input, std::vector<std::string>& fileList,
 
 
 // Function to process a single batch of paths and find files for findFiles
-std::set<std::string> processBatchPaths(const std::vector<std::string>& batchPaths, const std::string& mode, const std::function<void(const std::string&, const std::string&)>& callback,std::set<std::string>& processedErrorsFind) {
+std::set<std::string> processBatchPaths(const std::vector<std::string>& batchPaths, const std::string& mode, const std::function<void(const std::string&, const std::string&)>& callback,std::set<std::string>& processedErrorsFind, VisitedDirectories* visited, DiscoveredImages* discovered, ScanProgress* progress) {
     std::mutex fileNamesMutex;
-    std::atomic<size_t> totalFiles{0};
     std::set<std::string> localFileNames;
+    std::vector<std::string> traverseErrors;
+    std::vector<std::string> localIso, localBinImg, localMdf, localNrg; // Other formats for the discovery catalogs
+    ScanRules rules = loadScanRules();
+    const ImageKind modeKind = (mode == "mdf") ? ImageKind::Mdf : (mode == "nrg") ? ImageKind::Nrg : ImageKind::BinImg;
     
     disableInput();
 
-    for (const auto& path : batchPaths) {
-        try {
-            // Flags for blacklisting
-            bool blacklistMdf = (mode == "mdf");
-            bool blacklistNrg = (mode == "nrg");
-
-            // Traverse directory
-            for (const auto& entry : std::filesystem::recursive_directory_iterator(path)) {
-                if (entry.is_regular_file()) {
-                    totalFiles++;
-                    std::cout << "\r\033[0;1mTotal files processed: " << totalFiles << std::flush;
-                    
-                    if (blacklist(entry, blacklistMdf, blacklistNrg)) {
-                        std::string fileName = entry.path().string();
-                        // Thread-safe insertion
-                        {
-                            std::lock_guard<std::mutex> lock(fileNamesMutex);
-                            bool isInCache = false;
-                            if (mode == "nrg") {
-                                isInCache = (std::find(nrgFilesCache.begin(), nrgFilesCache.end(), fileName) != nrgFilesCache.end());
-                            } else if (mode == "mdf") {
-                                isInCache = (std::find(mdfMdsFilesCache.begin(), mdfMdsFilesCache.end(), fileName) != mdfMdsFilesCache.end());
-                            } else if (mode == "bin") {
-                                isInCache = (std::find(binImgFilesCache.begin(), binImgFilesCache.end(), fileName) != binImgFilesCache.end());
-                            }
-                            
-                            if (!isInCache) {
-                                if (localFileNames.insert(fileName).second) {
-                                    callback(fileName, entry.path().parent_path().string());
-                                }
-                            }
-                        }
-                    }
-                }
+    // Flags for blacklisting
+    bool blacklistMdf = (mode == "mdf");
+    bool blacklistNrg = (mode == "nrg");
+
+    // Counted into this batch's own slot, the caller's render thread does the printing
+    ScanProgress::Slot* processed = progress ? &progress->acquireSlot() : nullptr;
+    DirectoryWalker walker(-1, rules, [&](std::string_view name, const std::string& fullPath) {
+        if (processed) {
+            processed->count.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // One pass classifies every format, only this mode's files go through the blacklist
+        ImageKind kind = classifyImageName(name);
+        if (kind == ImageKind::None || (kind != modeKind && !discovered)) return;
+        if (rules.magicProbe && !matchesImageMagic(fullPath, kind)) return;
+
+        if (kind != modeKind) {
+            auto& bucket = (kind == ImageKind::Iso) ? localIso : (kind == ImageKind::BinImg) ? localBinImg : (kind == ImageKind::Mdf) ? localMdf : localNrg;
+            bucket.push_back(fullPath);
+            if (bucket.size() >= 100) {
+                discovered->append(kind, bucket);
             }
+            return;
+        }
+        if (!blacklist(fullPath, blacklistMdf, blacklistNrg)) return;
 
+        const std::string& fileName = fullPath;
+        // Thread-safe insertion
+        {
+            std::lock_guard<std::mutex> lock(fileNamesMutex);
+            bool isInCache = false;
+            if (mode == "nrg") {
+                isInCache = (std::find(nrgFilesCache.begin(), nrgFilesCache.end(), fileName) != nrgFilesCache.end());
+            } else if (mode == "mdf") {
+                isInCache = (std::find(mdfMdsFilesCache.begin(), mdfMdsFilesCache.end(), fileName) != mdfMdsFilesCache.end());
+            } else if (mode == "bin") {
+                isInCache = (std::find(binImgFilesCache.begin(), binImgFilesCache.end(), fileName) != binImgFilesCache.end());
+            }
             
-        } catch (const std::filesystem::filesystem_error& e) {
-            std::string errorMessage = "\033[1;91mError traversing path: " 
-                + path + " - " + e.what() + "\033[0;1m";
-            processedErrorsFind.insert(errorMessage);
+            if (!isInCache) {
+                if (localFileNames.insert(fileName).second) {
+                    callback(fileName, fileName.substr(0, fileName.find_last_of('/')));
+                }
+            }
         }
+    }, traverseErrors, visited);
+
+    // Traverse directories
+    for (const auto& path : batchPaths) {
+        walker.walk(path);
+    }
+    if (discovered) {
+        // This mode's own bucket stays empty, its files go through the blacklist and the callback instead
+        discovered->append(ImageKind::Iso, localIso);
+        discovered->append(ImageKind::BinImg, localBinImg);
+        discovered->append(ImageKind::Mdf, localMdf);
+        discovered->append(ImageKind::Nrg, localNrg);
     }
 
-    // If no files were processed at all
-    if (totalFiles == 0) {
-        std::cout << "\r\033[0;1mTotal files processed: 0\033[0m" << std::flush;
+    for (const auto& error : traverseErrors) {
+        std::string errorMessage = "\033[1;91mError traversing path: " + error + "\033[0;1m";
+        processedErrorsFind.insert(errorMessage);
     }
 
     return localFileNames;
@@ -590,6 +717,19 @@ std::vector<std::string> findFiles(const std::vector<std::string>& inputPaths, s
     for (const auto& originalPath : inputPaths) {
         std::string path = std::filesystem::path(originalPath).string();
         
+        // A folder walked by ImportISO or another mode is served from the catalog instead of the disk,
+        // only the entries merged from it were not in the RAM cache before, as a walk would report them
+        if (!path.empty() && consumeDiscoveredRoot(path, mode)) {
+            const std::unordered_set<std::string>& merged = mergedCatalogEntries[mode];
+            std::string prefix = (path.back() == '/') ? path : path + "/";
+            for (const auto& file : merged) {
+                if (file.compare(0, prefix.size(), prefix) == 0 && fileNames.insert(file).second) {
+                    callback(file, file.substr(0, file.find_last_of('/')));
+                }
+            }
+            continue;
+        }
+
         // Minimize critical section for checking unique paths
         {
             std::lock_guard<std::mutex> lock(pathsMutex);
@@ -613,10 +753,16 @@ std::vector<std::string> findFiles(const std::vector<std::string>& inputPaths, s
 
     // Batch processing with thread pool
     std::vector<std::future<std::set<std::string>>> batchFutures;
+    VisitedDirectories visited; // Overlapping paths are walked once across all batches
+    DiscoveredImages discovered; // ISO and other-format candidates found on the way
+    ScanProgress progress; // One counter line for all batches instead of one print per file
+    if (!pathBatches.empty()) {
+        progress.start();
+    }
     
     // Process batches with thread pool
     for (const auto& batch : pathBatches) {
-        batchFutures.push_back(std::async(std::launch::async, processBatchPaths, batch, mode, callback, std::ref(processedErrorsFind)));
+        batchFutures.push_back(std::async(std::launch::async, processBatchPaths, batch, mode, callback, std::ref(processedErrorsFind), &visited, &discovered, &progress));
 
         // Limit concurrent batches
         if (batchFutures.size() >= MAX_CONCURRENT_BATCHES) {
@@ -632,6 +778,7 @@ std::vector<std::string> findFiles(const std::vector<std::string>& inputPaths, s
         std::set<std::string> batchResults = future.get();
         fileNames.insert(batchResults.begin(), batchResults.end());
     }
+    progress.stop();
 
     // Update invalid directory paths
     invalidDirectoryPaths.insert(invalidPaths.begin(), invalidPaths.end());
@@ -678,6 +825,14 @@ std::vector<std::string> findFiles(const std::vector<std::string>& inputPaths, s
     if (!batch.empty()) {
         currentCache->insert(currentCache->end(), batch.begin(), batch.end());
     }
+
+    // Persist this mode's catalog and hand the other formats to their catalogs
+    saveImageCatalog(mode, *currentCache);
+    std::vector<std::string> walkedPaths;
+    for (const auto& pathBatch : pathBatches) {
+        walkedPaths.insert(walkedPaths.end(), pathBatch.begin(), pathBatch.end());
+    }
+    publishDiscoveredImages(discovered, walkedPaths, mode);
     
     // Restore input
     flushStdin();
@@ -2,10 +2,12 @@
 
 #include "../headers.h"
 #include "../threadpool.h"
+#include "../scan.h"
+#include "../search.h"
 
 
 // Function to process selected indices for cpMvDel accordingly
-void processOperationInput(const std::string& input, std::vector<std::string>& isoFiles, 
+void processOperationInput(const std::string& input, const ListView& isoFiles, 
     const std::string& process, std::set<std::string>& operationIsos, 
     std::set<std::string>& operationErrors, std::set<std::string>& uniqueErrorMessages, 
     bool& promptFlag, int& maxDepth, bool& umountMvRmBreak, bool& historyPattern, bool& verbose) {
@@ -19,7 +21,7 @@ void processOperationInput(const std::string& input, std::vector<std::string>& i
     std::string operationDescription = isDelete ? "*PERMANENTLY DELETED*" : (isMove ? "*MOVED*" : "*COPIED*");
     std::string operationColor = isDelete ? "\033[1;91m" : (isCopy ? "\033[1;92m" : "\033[1;93m");
 
-    tokenizeInput(input, isoFiles, uniqueErrorMessages, processedIndices);
+    tokenizeInput(input, isoFiles.size(), uniqueErrorMessages, processedIndices);
     
     if (!uniqueErrorMessages.empty()) {
         std::cout << "\n";
@@ -65,6 +67,7 @@ void processOperationInput(const std::string& input, std::vector<std::string>& i
 
     clearScrollBuffer();
     std::cout << "\n\033[0;1m Processing " + operationColor + process + "\033[0;1m operations...\n";
+    ForegroundActivity foreground; // AutoImportISO pauses until the files are processed
 
     std::vector<std::string> filesToProcess;
     for (const auto& index : processedIndices) {
@@ -138,7 +141,7 @@ void processOperationInput(const std::string& input, std::vector<std::string>& i
 
 
 // Function to prompt for userDestDir and Delete confirmation
-std::string userDestDirRm(std::vector<std::string>& isoFiles, std::vector<std::vector<int>>& indexChunks, std::string& userDestDir, std::string& operationColor, std::string& operationDescription, bool& umountMvRmBreak, bool& historyPattern, bool& isDelete, bool& isCopy, bool& abortDel) {
+std::string userDestDirRm(const ListView& isoFiles, std::vector<std::vector<int>>& indexChunks, std::string& userDestDir, std::string& operationColor, std::string& operationDescription, bool& umountMvRmBreak, bool& historyPattern, bool& isDelete, bool& isCopy, bool& abortDel) {
 	
 	    auto displaySelectedIsos = [&]() {
         std::cout << "\n";
@@ -247,7 +250,7 @@ bool bufferedCopyWithProgress(const fs::path& src, const fs::path& dst, std::ato
 }
 
 // Function to handle cpMvDel
-void handleIsoFileOperation(const std::vector<std::string>& isoFiles, std::vector<std::string>& isoFilesCopy, std::set<std::string>& operationIsos, std::set<std::string>& operationErrors, const std::string& userDestDir, bool isMove, bool isCopy, bool isDelete, std::atomic<size_t>* completedBytes, std::atomic<size_t>* completedTasks) {
+void handleIsoFileOperation(const std::vector<std::string>& isoFiles, const ListView& isoFilesCopy, std::set<std::string>& operationIsos, std::set<std::string>& operationErrors, const std::string& userDestDir, bool isMove, bool isCopy, bool isDelete, std::atomic<size_t>* completedBytes, std::atomic<size_t>* completedTasks) {
     
     bool operationSuccessful = true;
     uid_t real_uid;
@@ -376,8 +379,9 @@ void handleIsoFileOperation(const std::vector<std::string>& isoFiles, std::vecto
         fs::path isoPath(iso);
         auto [isoDir, isoFile] = extractDirectoryAndFilename(isoPath.string());
 
-        auto it = std::find(isoFilesCopy.begin(), isoFilesCopy.end(), iso);
-        if (it != isoFilesCopy.end()) {
+        // Selections come from the view, the check is against the cached list it shows
+        auto it = std::find(isoFilesCopy.base().begin(), isoFilesCopy.base().end(), iso);
+        if (it != isoFilesCopy.base().end()) {
             if (fs::exists(isoPath)) {
                 isoFilesToOperate.push_back(iso);
             } else {
@@ -2,6 +2,15 @@
 
 #include "../headers.h"
 #include "../threadpool.h"
+#include "../search.h"
+#include "../metaio.h"
+#include "../mounttable.h"
+#include <sys/ioctl.h>
+#include <climits>
+#include <cmath>
+#include <ctime>
+#include <numeric>
+#include <optional>
 
 
 // Conver strings to lowercase efficiently
@@ -11,82 +20,6 @@ void toLowerInPlace(std::string& str) {
     }
 }
 
-// Boyer-Moore string search implementation for files
-std::vector<size_t> boyerMooreSearch(const std::string& pattern, const std::string& text) {
-    const size_t patternLen = pattern.length();
-    const size_t textLen = text.length();
-    
-    // Early exit conditions
-    if (patternLen == 0 || textLen == 0 || patternLen > textLen) 
-        return {};
-    
-    // Single character optimization
-    if (patternLen == 1) {
-        std::vector<size_t> matches;
-        for (size_t i = 0; i < textLen; ++i) 
-            if (text[i] == pattern[0]) 
-                matches.push_back(i);
-        return matches;
-    }
-    
-    // Preprocess bad character shifts
-    std::vector<size_t> badCharShifts(256, patternLen);
-    for (size_t i = 0; i < patternLen - 1; ++i) 
-        badCharShifts[static_cast<unsigned char>(pattern[i])] = patternLen - i - 1;
-    
-    // Preprocess good suffix shifts
-    std::vector<size_t> goodSuffixShifts(patternLen, patternLen);
-    std::vector<size_t> suffixLengths(patternLen, 0);
-    
-    // Compute suffix lengths and good suffix shifts
-    suffixLengths[patternLen - 1] = patternLen;
-    size_t lastPrefixPosition = patternLen;
-    
-    for (int i = patternLen - 2; i >= 0; --i) {
-        if (memcmp(pattern.c_str() + i + 1, pattern.c_str() + patternLen - lastPrefixPosition, lastPrefixPosition - (i + 1)) == 0) {
-            suffixLengths[i] = lastPrefixPosition - (i + 1);
-            lastPrefixPosition = i + 1;
-        }
-    }
-    
-    // Update good suffix shifts
-    for (size_t i = 0; i < patternLen; ++i) {
-        if (suffixLengths[i] == i + 1) {
-            for (size_t j = 0; j < patternLen - i - 1; ++j) 
-                if (goodSuffixShifts[j] == patternLen) 
-                    goodSuffixShifts[j] = patternLen - i - 1;
-        }
-        
-        if (suffixLengths[i] > 0) 
-            goodSuffixShifts[patternLen - suffixLengths[i]] = patternLen - i - 1;
-    }
-    
-    // Search phase
-    std::vector<size_t> matches;
-    for (size_t i = 0; i <= textLen - patternLen;) {
-        size_t skip = 0;
-        while (skip < patternLen && pattern[patternLen - 1 - skip] == text[i + patternLen - 1 - skip]) 
-            ++skip;
-        
-        // Pattern found
-        if (skip == patternLen) 
-            matches.push_back(i);
-        
-        // Compute shift
-        size_t badCharShift = (i + patternLen < textLen) 
-            ? badCharShifts[static_cast<unsigned char>(text[i + patternLen - 1])] 
-            : 1;
-        
-        size_t goodSuffixShift = goodSuffixShifts[skip];
-        
-        // Take the maximum shift
-        i += std::max(1ul, std::min(badCharShift, goodSuffixShift));
-    }
-    
-    return matches;
-}
-
-
 // Remove AnsiCodes from filenames
 std::string removeAnsiCodes(const std::string& input) {
     std::string result;
@@ -104,72 +37,889 @@ std::string removeAnsiCodes(const std::string& input) {
 }
 
 
-// Function to filter cached ISO files or mountpoints based on search query (case-insensitive)
-std::vector<std::string> filterFiles(const std::vector<std::string>& files, const std::string& query) {
-    std::vector<std::string> filteredFiles;
-    std::set<std::string> queryTokens;
+// SEARCH INDEX
+
+SearchIndex globalIsoSearchIndex;
+
+const std::string filterRulesFilePath = std::string(getenv("HOME")) + "/.config/isocmd/config/iso_commander_filter.txt";
+
+// Rows per filter task, smaller lists are scanned on the calling thread
+static constexpr size_t MIN_ROWS_PER_TASK = 8192;
+
+
+// Function to read the filter settings, one key=value per line, '#' starts a comment
+FilterRules loadFilterRules() {
+    FilterRules rules;
+    for (const auto& [key, value] : readConfigPairs(filterRulesFilePath)) {
+        if (key == "trigram_index") {
+            rules.trigramIndex = (value == "1");
+        } else if (key == "live_filter") {
+            rules.liveFilter = (value == "1");
+        } else if (key == "ignore_accents") {
+            rules.ignoreAccents = (value == "1");
+        } else if (key == "fuzzy_results") {
+            try {
+                rules.fuzzyResults = std::max<size_t>(1, std::stoul(value));
+            } catch (const std::exception&) {
+                // Keep the default on malformed values
+            }
+        }
+    }
+    return rules;
+}
 
-    // Tokenize the query and convert each token to lowercase
-    std::stringstream ss(query);
+
+// Function to tell fuzzy queries apart, they start with '~'
+bool isFuzzyQuery(const std::string& query) {
+    return !query.empty() && query[0] == '~';
+}
+
+
+// Function to split a query into its distinct ';' terms, folded like the index rows
+static std::set<std::string> splitQueryTerms(const std::string& query, bool stripMarks) {
+    std::set<std::string> uniqueTokens;
+
+    // Tokenize the query and fold each token
+    std::stringstream ss(isFuzzyQuery(query) ? query.substr(1) : query);
     std::string token;
     
     while (std::getline(ss, token, ';')) {
-        toLowerInPlace(token);
-        queryTokens.insert(token);
+        token = foldedText(token, stripMarks);
+        if (!token.empty()) {
+            uniqueTokens.insert(token);
+        }
     }
+    return uniqueTokens;
+}
 
-    // This mutex will only be used for the final merge
-    std::mutex filterMutex;
 
-    auto filterTask = [&](size_t start, size_t end) {
-    std::vector<std::string> localFilteredFiles;
-    for (size_t i = start; i < end; ++i) {
-        const std::string& file = files[i];
-        std::string cleanFileName = removeAnsiCodes(file);  // Remove ANSI codes first
-        std::string fileName = cleanFileName;  // Copy the clean file name
-        toLowerInPlace(fileName);  // Convert once to lowercase
-
-        // Check if any of the query tokens is found in the file name
-        bool matchFound = false;
-        for (const std::string& queryToken : queryTokens) {
-            if (!boyerMooreSearch(queryToken, fileName).empty()) {
-                matchFound = true;
-                break;
+// Function to run a task over slices of count items, on a pool when there is enough work for several threads
+template <typename Task>
+static auto runSliced(size_t count, const Task& task) -> std::vector<decltype(task(size_t(0), size_t(0)))> {
+    using Result = decltype(task(size_t(0), size_t(0)));
+    size_t numTasks = std::max<size_t>(1, std::min<size_t>(maxThreads, count / MIN_ROWS_PER_TASK));
+    size_t batchSize = (count + numTasks - 1) / numTasks;
+
+    std::vector<Result> results;
+    if (numTasks == 1) {
+        results.push_back(task(0, count));
+        return results;
+    }
+
+    ThreadPool pool(numTasks);
+    std::vector<std::future<Result>> futures;
+    for (size_t i = 0; i < count; i += batchSize) {
+        size_t end = std::min(i + batchSize, count);
+        futures.push_back(pool.enqueue([&task, i, end]() { return task(i, end); }));
+    }
+    for (auto& future : futures) {
+        results.push_back(future.get());
+    }
+    return results;
+}
+
+
+// Matching rows of one query in list order, with their fuzzy scores when the query is fuzzy
+struct RowMatches {
+    std::vector<uint32_t> rows;
+    std::vector<int> scores;    // Parallel to rows, empty for substring queries
+};
+
+
+// Function to pick the index for a list, the ISO list has a ready one and any other list is indexed into localIndex
+static const SearchIndex& indexForList(const std::vector<std::string>& files, bool stripMarks, SearchIndex& localIndex) {
+    if (&files == &globalIsoFileList && globalIsoSearchIndex.size() == files.size() && globalIsoSearchIndex.stripsMarks() == stripMarks) {
+        return globalIsoSearchIndex;
+    }
+    localIndex.setStripMarks(stripMarks);
+    localIndex.build(files);
+    return localIndex;
+}
+
+
+// STRUCTURED QUERIES
+
+// Field tested by one word of a structured query
+enum class QueryField { Text, Name, Dir, Ext, Glob, Regex, Mounted, Size, Mtime, Label };
+
+// One compiled word of a structured query
+struct QueryPredicate {
+    QueryField field = QueryField::Text;
+    bool negated = false;
+    char comparison = '=';              // '<', '>' or '=' for size and mtime
+    bool orEqual = false;               // '<=' and '>='
+    uint64_t number = 0;                // Bytes for size, seconds of age for mtime
+    bool wantMounted = true;
+    std::string text;                   // Lowercase needle of label and ext
+    std::optional<CompiledToken> token; // Needle of the path fields
+    std::optional<PatternDfa> pattern;  // Compiled glob or regex, run over the whole row
+};
+
+// Alternatives of predicates that all have to hold, a row matches if one alternative does
+struct StructuredQuery {
+    std::vector<std::vector<QueryPredicate>> alternatives;
+    int64_t now = 0;                    // Reference time of the mtime predicates
+    std::string error;                  // Why a pattern did not compile, nothing matches then
+};
+
+// One word of a query, quoted words are always plain terms
+struct QueryWord {
+    std::string text;
+    bool quoted = false;
+};
+
+
+// Metadata of the rows of a list, each column is looked up for a row the first time a predicate needs it
+struct QueryColumns {
+    std::vector<PathStat> stats;
+    std::vector<uint8_t> statLoaded;
+    std::vector<std::string> labels;
+    std::vector<uint8_t> labelLoaded;
+    bool mountsLoaded = false;        // The mount table was refreshed for this list
+};
+
+// A list being filtered, with its index and the metadata its queries looked up so far
+struct FilterList {
+    const std::vector<std::string>& files;
+    bool stripMarks;                 // Rows and queries are folded without diacritics
+    SearchIndex localIndex;
+    const SearchIndex* index;
+    QueryColumns columns;
+
+    explicit FilterList(const std::vector<std::string>& files) : files(files), stripMarks(loadFilterRules().ignoreAccents), index(&indexForList(files, stripMarks, localIndex)) {}
+};
+
+
+// Parts of a normalized row the field qualifiers test
+struct RowFields {
+    std::string_view dir;
+    std::string_view name;
+    std::string_view ext;
+    bool mountPoint = false;
+};
+
+
+// Function to split a row into its fields, an isocmd mount point is named after its ISO
+static RowFields rowFields(std::string_view row) {
+    RowFields fields;
+    size_t slash = row.rfind('/');
+    fields.dir = row.substr(0, slash == std::string_view::npos ? 0 : slash);
+    fields.name = slash == std::string_view::npos ? row : row.substr(slash + 1);
+
+    if (fields.dir == "/mnt" && fields.name.compare(0, 4, "iso_") == 0) {
+        fields.mountPoint = true;
+        fields.name.remove_prefix(4);
+        size_t tilde = fields.name.rfind('~');
+        if (tilde != std::string_view::npos) fields.name = fields.name.substr(0, tilde);
+        fields.ext = "iso"; // Only ISO images are mounted
+        return fields;
+    }
+
+    size_t dot = fields.name.rfind('.');
+    if (dot != std::string_view::npos && dot > 0) fields.ext = fields.name.substr(dot + 1);
+    return fields;
+}
+
+
+// Function to split a query into words at spaces and ';', double quotes keep spaces inside a word
+static std::vector<QueryWord> splitQueryWords(const std::string& query) {
+    std::vector<QueryWord> words;
+    QueryWord word;
+    bool inQuotes = false;
+    bool started = false;
+    auto finish = [&]() {
+        if (started) words.push_back(std::move(word));
+        word = QueryWord();
+        started = false;
+    };
+
+    for (char c : query) {
+        if (c == '"') {
+            if (!started) word.quoted = true;
+            inQuotes = !inQuotes;
+            started = true;
+        } else if (!inQuotes && (c == ' ' || c == '\t')) {
+            finish();
+        } else if (!inQuotes && c == ';') {
+            finish();
+            words.push_back({";", false});
+        } else {
+            word.text += c;
+            started = true;
+        }
+    }
+    finish();
+    return words;
+}
+
+
+// Function to parse a number with a unit suffix, scaled by the factor of its unit
+static bool parseScaledNumber(std::string_view value, const std::vector<std::pair<std::string, uint64_t>>& units, uint64_t defaultUnit, uint64_t& result) {
+    std::string text(value);
+    char* end = nullptr;
+    double number = std::strtod(text.c_str(), &end);
+    if (end == text.c_str() || number < 0 || !std::isfinite(number)) return false;
+
+    std::string unit(end);
+    uint64_t factor = defaultUnit;
+    if (!unit.empty()) {
+        auto match = std::find_if(units.begin(), units.end(), [&](const auto& entry) { return entry.first == unit; });
+        if (match == units.end()) return false;
+        factor = match->second;
+    }
+    double scaled = number * static_cast<double>(factor);
+    if (scaled >= 1.8e19) return false;
+    result = static_cast<uint64_t>(scaled);
+    return true;
+}
+
+
+// Function to compile a word into a field predicate, false if it is a plain term.
+// Values are folded like the rows, patterns keep the case of their ASCII letters for escapes like \D.
+static bool parsePredicate(const std::string& rawWord, QueryPredicate& predicate, std::string& error, bool stripMarks) {
+    std::string word = foldedText(rawWord, stripMarks);
+    for (QueryField field : {QueryField::Glob, QueryField::Regex}) {
+        std::string_view prefix = field == QueryField::Glob ? "glob:" : "re:";
+        if (word.size() <= prefix.size() || word.compare(0, prefix.size(), prefix) != 0) continue;
+        std::string value;
+        appendFolded(std::string_view(rawWord).substr(prefix.size()), value, stripMarks, false);
+        predicate.field = field;
+        predicate.pattern.emplace();
+        bool compiled = field == QueryField::Glob ? predicate.pattern->compileGlob(value, error) : predicate.pattern->compileRegex(value, error);
+        if (!compiled) error = std::string(prefix) + std::string(rawWord.substr(prefix.size())) + ": " + error;
+        return true;
+    }
+
+    static const std::vector<std::pair<std::string, QueryField>> textFields = {
+        {"name:", QueryField::Name}, {"dir:", QueryField::Dir}, {"ext:", QueryField::Ext},
+        {"label:", QueryField::Label}, {"mounted:", QueryField::Mounted}};
+    for (const auto& [prefix, field] : textFields) {
+        if (word.size() <= prefix.size() || word.compare(0, prefix.size(), prefix) != 0) continue;
+        std::string value = word.substr(prefix.size());
+        predicate.field = field;
+        if (field == QueryField::Mounted) {
+            if (value == "yes" || value == "y" || value == "1" || value == "true") predicate.wantMounted = true;
+            else if (value == "no" || value == "n" || value == "0" || value == "false") predicate.wantMounted = false;
+            else return false;
+        } else if (field == QueryField::Ext) {
+            predicate.text = value[0] == '.' ? value.substr(1) : value;
+        } else if (field == QueryField::Label) {
+            predicate.text = value;
+        } else {
+            predicate.token.emplace(value);
+        }
+        return true;
+    }
+
+    static const std::vector<std::pair<std::string, uint64_t>> sizeUnits = {
+        {"b", 1}, {"k", 1ULL << 10}, {"kb", 1ULL << 10}, {"kib", 1ULL << 10}, {"m", 1ULL << 20}, {"mb", 1ULL << 20}, {"mib", 1ULL << 20},
+        {"g", 1ULL << 30}, {"gb", 1ULL << 30}, {"gib", 1ULL << 30}, {"t", 1ULL << 40}, {"tb", 1ULL << 40}, {"tib", 1ULL << 40}};
+    static const std::vector<std::pair<std::string, uint64_t>> ageUnits = {
+        {"s", 1}, {"h", 3600}, {"d", 86400}, {"w", 7 * 86400}, {"y", 365 * 86400}};
+    for (QueryField field : {QueryField::Size, QueryField::Mtime}) {
+        std::string_view prefix = field == QueryField::Size ? "size" : "mtime";
+        if (word.compare(0, prefix.size(), prefix) != 0 || word.size() < prefix.size() + 2) continue;
+        size_t position = prefix.size();
+        char comparison = word[position++];
+        if (comparison != '<' && comparison != '>' && comparison != '=') return false;
+        bool orEqual = comparison != '=' && word[position] == '=';
+        if (orEqual) ++position;
+
+        predicate.field = field;
+        predicate.comparison = comparison;
+        predicate.orEqual = orEqual;
+        return field == QueryField::Size
+            ? parseScaledNumber(std::string_view(word).substr(position), sizeUnits, 1, predicate.number)
+            : parseScaledNumber(std::string_view(word).substr(position), ageUnits, 86400, predicate.number);
+    }
+    return false;
+}
+
+
+// Function to compile a query with operators or field qualifiers, false for a plain ';' term list.
+// ';' and OR separate alternatives, every other word has to match, NOT or a leading '-' negates a word.
+// Spaces and '-' alone do not make a query structured, so plain queries keep matching names with spaces and dashes literally.
+static bool compileStructuredQuery(const std::string& query, StructuredQuery& compiled, bool stripMarks) {
+    if (isFuzzyQuery(query)) return false;
+
+    bool structured = false;
+    compiled.alternatives.assign(1, {});
+    compiled.now = static_cast<int64_t>(std::time(nullptr));
+    bool negateNext = false;
+    for (const QueryWord& word : splitQueryWords(query)) {
+        if (!word.quoted && (word.text == ";" || word.text == "OR")) {
+            if (!compiled.alternatives.back().empty()) compiled.alternatives.emplace_back();
+            structured = structured || word.text == "OR";
+            negateNext = false;
+            continue;
+        }
+        if (!word.quoted && (word.text == "AND" || word.text == "NOT")) {
+            if (word.text == "NOT") negateNext = !negateNext;
+            structured = true;
+            continue;
+        }
+
+        std::string body = word.text;
+        bool negated = negateNext;
+        negateNext = false;
+        if (!word.quoted && body.size() > 1 && body[0] == '-') {
+            negated = !negated;
+            body.erase(0, 1);
+        }
+        if (body.empty()) continue;
+
+        QueryPredicate predicate;
+        std::string error;
+        if (!word.quoted && parsePredicate(body, predicate, error, stripMarks)) {
+            structured = true;
+            if (compiled.error.empty()) compiled.error = error;
+        } else {
+            predicate = QueryPredicate();
+            predicate.token.emplace(foldedText(body, stripMarks));
+        }
+        predicate.negated = negated;
+        compiled.alternatives.back().push_back(std::move(predicate));
+    }
+    if (compiled.alternatives.back().empty()) compiled.alternatives.pop_back();
+    return structured;
+}
+
+
+// Function to bring the shared mount table up to date once per list
+static void loadMountColumn(QueryColumns& columns) {
+    if (columns.mountsLoaded) return;
+    columns.mountsLoaded = true;
+    globalMountTable.refresh();
+}
+
+
+// Function to stat the rows that have not been looked up yet, mount points report the size of their filesystem
+static void loadStatColumn(FilterList& list, const std::vector<uint32_t>& rows) {
+    QueryColumns& columns = list.columns;
+    columns.stats.resize(list.files.size());
+    columns.statLoaded.resize(list.files.size(), 0);
+
+    std::vector<uint32_t> missing;
+    std::vector<std::string> paths;
+    for (uint32_t row : rows) {
+        if (columns.statLoaded[row]) continue;
+        missing.push_back(row);
+        paths.push_back(removeAnsiCodes(list.files[row]));
+    }
+    if (missing.empty()) return;
+
+    std::vector<PathStat> stats = statPaths(paths);
+    for (size_t i = 0; i < missing.size(); ++i) {
+        struct statvfs vfs;
+        if (stats[i].error == 0 && rowFields(list.index->row(missing[i])).mountPoint && statvfs(paths[i].c_str(), &vfs) == 0) {
+            stats[i].size = static_cast<uint64_t>(vfs.f_blocks) * vfs.f_frsize;
+        }
+        columns.stats[missing[i]] = stats[i];
+        columns.statLoaded[missing[i]] = 1;
+    }
+}
+
+
+// Function to read the labels of the rows that have not been read yet, mount points through their loop device
+static void loadLabelColumn(FilterList& list, const std::vector<uint32_t>& rows) {
+    QueryColumns& columns = list.columns;
+    columns.labels.resize(list.files.size());
+    columns.labelLoaded.resize(list.files.size(), 0);
+    loadMountColumn(columns);
+
+    std::vector<uint32_t> missing;
+    std::vector<std::string> sources;
+    for (uint32_t row : rows) {
+        if (columns.labelLoaded[row]) continue;
+        std::string path = removeAnsiCodes(list.files[row]);
+        if (rowFields(list.index->row(row)).mountPoint) {
+            MountEntry mount;
+            path = globalMountTable.find(path, mount) ? mount.source : std::string();
+        }
+        missing.push_back(row);
+        sources.push_back(std::move(path));
+    }
+    if (missing.empty()) return;
+
+    // Every read is a seek on a different file, so overlap them on all cores
+    size_t numThreads = std::max<size_t>(1, std::min<size_t>(maxThreads, missing.size()));
+    size_t chunkSize = (missing.size() + numThreads - 1) / numThreads;
+    ThreadPool pool(numThreads);
+    std::vector<std::future<void>> futures;
+    for (size_t begin = 0; begin < missing.size(); begin += chunkSize) {
+        size_t end = std::min(begin + chunkSize, missing.size());
+        futures.push_back(pool.enqueue([&, begin, end]() {
+            for (size_t i = begin; i < end; ++i) {
+                columns.labels[missing[i]] = sources[i].empty() ? std::string() : foldedText(probeIsoVolume(sources[i]).label, list.stripMarks);
+            }
+        }));
+    }
+    for (auto& future : futures) {
+        future.get();
+    }
+    for (uint32_t row : missing) {
+        columns.labelLoaded[row] = 1;
+    }
+}
+
+
+// Function to compare a number with the bound of a size or mtime predicate
+static bool compareBound(const QueryPredicate& predicate, uint64_t value) {
+    switch (predicate.comparison) {
+        case '<': return value < predicate.number || (predicate.orEqual && value == predicate.number);
+        case '>': return value > predicate.number || (predicate.orEqual && value == predicate.number);
+        default: return value == predicate.number;
+    }
+}
+
+
+// Function to test one row, the columns the predicate needs are already loaded
+static bool predicateHolds(const QueryPredicate& predicate, const FilterList& list, const StructuredQuery& query, uint32_t row) {
+    std::string_view text = list.index->row(row);
+    bool result = false;
+    switch (predicate.field) {
+        case QueryField::Text:
+            result = predicate.token->foundIn(text);
+            break;
+        case QueryField::Name:
+            result = predicate.token->foundIn(rowFields(text).name);
+            break;
+        case QueryField::Dir:
+            result = predicate.token->foundIn(rowFields(text).dir);
+            break;
+        case QueryField::Ext:
+            result = rowFields(text).ext == predicate.text;
+            break;
+        case QueryField::Glob:
+        case QueryField::Regex:
+            result = predicate.pattern->matches(text);
+            break;
+        case QueryField::Mounted: {
+            const std::string& file = list.files[row];
+            const std::string mountPoint = rowFields(text).mountPoint ? removeAnsiCodes(file) : isoMountPoint(removeAnsiCodes(file));
+            result = globalMountTable.contains(mountPoint);
+            result = result == predicate.wantMounted;
+            break;
+        }
+        case QueryField::Size: {
+            const PathStat& stat = list.columns.stats[row];
+            result = stat.error == 0 && compareBound(predicate, stat.size);
+            break;
+        }
+        case QueryField::Mtime: {
+            const PathStat& stat = list.columns.stats[row];
+            result = stat.error == 0 && compareBound(predicate, static_cast<uint64_t>(std::max<int64_t>(0, query.now - stat.mtime)));
+            break;
+        }
+        case QueryField::Label: {
+            const std::string& label = list.columns.labels[row];
+            result = !label.empty() && label.find(predicate.text) != std::string::npos;
+            break;
+        }
+    }
+    return result != predicate.negated;
+}
+
+
+// Function to rank predicates by what they cost per row: path bytes, then the mount table, then stat, then reading the image
+static int predicateCost(const QueryPredicate& predicate) {
+    switch (predicate.field) {
+        case QueryField::Mounted: return 1;
+        case QueryField::Size:
+        case QueryField::Mtime: return 2;
+        case QueryField::Label: return 3;
+        default: return 0;
+    }
+}
+
+
+// Function to estimate the share of rows a predicate keeps.
+// Path predicates are tried on an even sample of the rows, the costlier ones use fixed guesses.
+static double predicateSelectivity(const QueryPredicate& predicate, const FilterList& list, const StructuredQuery& query, const std::vector<uint32_t>& rows) {
+    static constexpr size_t SAMPLE_ROWS = 256;
+    if (predicateCost(predicate) == 0) {
+        size_t step = std::max<size_t>(1, rows.size() / SAMPLE_ROWS);
+        size_t sampled = 0, kept = 0;
+        for (size_t i = 0; i < rows.size(); i += step, ++sampled) {
+            kept += predicateHolds(predicate, list, query, rows[i]) ? 1 : 0;
+        }
+        return sampled == 0 ? 1.0 : static_cast<double>(kept) / sampled;
+    }
+
+    double guess = predicate.field == QueryField::Mounted ? (predicate.wantMounted ? 0.05 : 0.95) :
+                   predicate.field == QueryField::Label ? 0.1 : 0.5;
+    return predicate.negated ? 1.0 - guess : guess;
+}
+
+
+// Function to evaluate a structured query over the rows of a list, only among within when it is given.
+// Each alternative runs its predicates cheapest and most selective first, every predicate only
+// sees the rows the ones before it kept and an alternative stops as soon as no row is left.
+static std::vector<uint32_t> structuredQueryRows(FilterList& list, const StructuredQuery& query, const std::vector<uint32_t>* within) {
+    std::vector<uint32_t> allRows;
+    if (!within) {
+        allRows.resize(list.index->size());
+        std::iota(allRows.begin(), allRows.end(), 0);
+        within = &allRows;
+    }
+
+    // Rows of a ranked view are evaluated in list order and handed back in the view's order
+    const std::vector<uint32_t>* ranked = nullptr;
+    std::vector<uint32_t> sortedRows;
+    if (!std::is_sorted(within->begin(), within->end())) {
+        ranked = within;
+        sortedRows = *within;
+        std::sort(sortedRows.begin(), sortedRows.end());
+        within = &sortedRows;
+    }
+
+    std::vector<uint32_t> matched;
+    if (!query.error.empty()) return matched;
+    for (const auto& alternative : query.alternatives) {
+        // Rows an earlier alternative matched are not tested again
+        std::vector<uint32_t> survivors;
+        std::set_difference(within->begin(), within->end(), matched.begin(), matched.end(), std::back_inserter(survivors));
+
+        std::vector<std::pair<std::pair<int, double>, const QueryPredicate*>> order;
+        for (const QueryPredicate& predicate : alternative) {
+            order.push_back({{predicateCost(predicate), predicateSelectivity(predicate, list, query, survivors)}, &predicate});
+        }
+        std::stable_sort(order.begin(), order.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        for (const auto& [rank, predicate] : order) {
+            if (survivors.empty()) break;
+            if (predicate->field == QueryField::Mounted) loadMountColumn(list.columns);
+            if (predicate->field == QueryField::Size || predicate->field == QueryField::Mtime) loadStatColumn(list, survivors);
+            if (predicate->field == QueryField::Label) loadLabelColumn(list, survivors);
+
+            std::vector<std::vector<uint32_t>> batches = runSliced(survivors.size(), [&](size_t start, size_t end) {
+                std::vector<uint32_t> kept;
+                for (size_t i = start; i < end; ++i) {
+                    if (predicateHolds(*predicate, list, query, survivors[i])) kept.push_back(survivors[i]);
+                }
+                return kept;
+            });
+            survivors.clear();
+            for (const auto& batch : batches) {
+                survivors.insert(survivors.end(), batch.begin(), batch.end());
             }
         }
 
-        if (matchFound) {
-            localFilteredFiles.push_back(file);  // Push back the original file name with color codes
+        std::vector<uint32_t> merged;
+        merged.reserve(matched.size() + survivors.size());
+        std::merge(matched.begin(), matched.end(), survivors.begin(), survivors.end(), std::back_inserter(merged));
+        matched = std::move(merged);
+    }
+
+    if (ranked) {
+        std::vector<uint32_t> inViewOrder;
+        for (uint32_t row : *ranked) {
+            if (std::binary_search(matched.begin(), matched.end(), row)) inViewOrder.push_back(row);
         }
+        return inViewOrder;
+    }
+    return matched;
+}
+
+
+// Function to find the index rows matching a query, only among within when it is given
+static RowMatches filterIndexRows(FilterList& list, const std::string& query, const std::vector<uint32_t>* within) {
+    StructuredQuery structured;
+    if (compileStructuredQuery(query, structured, list.stripMarks)) {
+        RowMatches matches;
+        matches.rows = structuredQueryRows(list, structured, within);
+        return matches;
     }
 
-        // Merge local results into the global filteredFiles vector
-        std::lock_guard<std::mutex> lock(filterMutex);
-        filteredFiles.insert(filteredFiles.end(), localFilteredFiles.begin(), localFilteredFiles.end());
+    const SearchIndex& index = *list.index;
+    const bool fuzzy = isFuzzyQuery(query);
+    std::set<std::string> terms = splitQueryTerms(query, list.stripMarks);
+
+    // Each substring term is prepared once for the whole scan
+    std::vector<CompiledToken> queryTokens;
+    queryTokens.reserve(terms.size());
+    for (const std::string& term : terms) {
+        queryTokens.emplace_back(term);
+    }
+
+    // With a trigram index only the rows sharing every trigram of a token are verified
+    std::vector<uint32_t> candidates;
+    if (!within && !fuzzy && index.candidateRows(queryTokens, candidates)) {
+        within = &candidates;
+    }
+    auto rowAt = [within](size_t position) -> uint32_t {
+        return within ? (*within)[position] : static_cast<uint32_t>(position);
     };
 
-    size_t numFiles = files.size();
-    size_t numThreads = std::min(static_cast<size_t>(maxThreads), numFiles);
+    // Pure scan over the index bytes, no per-row allocations; fuzzy rows keep their best term score
+    auto filterTask = [&](size_t start, size_t end) {
+        RowMatches local;
+        for (size_t position = start; position < end; ++position) {
+            uint32_t i = rowAt(position);
+            std::string_view row = index.row(i);
+            if (fuzzy) {
+                int best = INT_MIN;
+                for (const std::string& term : terms) {
+                    int score = 0;
+                    if (fuzzyMatch(row, term, score)) best = std::max(best, score);
+                }
+                if (best != INT_MIN) {
+                    local.rows.push_back(i);
+                    local.scores.push_back(best);
+                }
+                continue;
+            }
+            for (const CompiledToken& queryToken : queryTokens) {
+                if (queryToken.foundIn(row)) {
+                    local.rows.push_back(i);
+                    break;
+                }
+            }
+        }
+        return local;
+    };
 
-    // Calculate the batch size based on the number of threads
-    size_t batchSize = (numFiles + numThreads - 1) / numThreads; // This ensures at least one file per thread
+    // Merge in list order
+    std::vector<RowMatches> batches = runSliced(within ? within->size() : index.size(), filterTask);
+    if (batches.size() == 1) {
+        return std::move(batches.front());
+    }
+    RowMatches matches;
+    for (const auto& batch : batches) {
+        matches.rows.insert(matches.rows.end(), batch.rows.begin(), batch.rows.end());
+        matches.scores.insert(matches.scores.end(), batch.scores.begin(), batch.scores.end());
+    }
+    return matches;
+}
 
-    std::vector<std::future<void>> futures;
 
-    // Launch threads to process files in batches
-    for (size_t i = 0; i < numFiles; i += batchSize) {
-        size_t start = i;
-        size_t end = std::min(i + batchSize, numFiles);
-        
-        // Launch each batch processing task asynchronously
-        futures.push_back(std::async(std::launch::async, filterTask, start, end));
+// Function to pick the limit best fuzzy matches, best first; ties go to the shorter path, then to list order.
+// Every slice keeps only its own top rows with a partial sort, so the matches are never sorted in full.
+static std::vector<uint32_t> topRankedRows(const SearchIndex& index, const RowMatches& matches, size_t limit) {
+    auto better = [&](size_t a, size_t b) {
+        if (matches.scores[a] != matches.scores[b]) return matches.scores[a] > matches.scores[b];
+        size_t lengthA = index.row(matches.rows[a]).size();
+        size_t lengthB = index.row(matches.rows[b]).size();
+        if (lengthA != lengthB) return lengthA < lengthB;
+        return a < b;
+    };
+    auto topOf = [&](std::vector<size_t>& positions) {
+        size_t keep = std::min(limit, positions.size());
+        std::partial_sort(positions.begin(), positions.begin() + keep, positions.end(), better);
+        positions.resize(keep);
+    };
+
+    std::vector<std::vector<size_t>> sliceTops = runSliced(matches.rows.size(), [&](size_t start, size_t end) {
+        std::vector<size_t> positions(end - start);
+        std::iota(positions.begin(), positions.end(), start);
+        topOf(positions);
+        return positions;
+    });
+
+    std::vector<size_t> merged;
+    for (const auto& top : sliceTops) {
+        merged.insert(merged.end(), top.begin(), top.end());
     }
+    topOf(merged);
 
-    // Wait for all threads to finish
-    for (auto& future : futures) {
-        future.wait();
+    std::vector<uint32_t> rows;
+    rows.reserve(merged.size());
+    for (size_t position : merged) {
+        rows.push_back(matches.rows[position]);
+    }
+    return rows;
+}
+
+
+// Function to filter the rows of a view, a filtered view only has its own rows tested.
+// Fuzzy queries return the best matches ranked, everything else keeps the view order.
+std::vector<uint32_t> filterRows(const ListView& view, const std::string& query) {
+    FilterList list(view.base());
+    RowMatches matches = filterIndexRows(list, query, view.filteredRows());
+    if (isFuzzyQuery(query)) {
+        return topRankedRows(*list.index, matches, loadFilterRules().fuzzyResults);
     }
+    return std::move(matches.rows);
+}
+
 
+// Function to filter cached ISO files or mountpoints based on search query (case-insensitive)
+std::vector<std::string> filterFiles(const std::vector<std::string>& files, const std::string& query) {
+    // Original strings keep their color codes
+    std::vector<std::string> filteredFiles;
+    for (uint32_t row : filterRows(ListView(files), query)) {
+        filteredFiles.push_back(files[row]);
+    }
     return filteredFiles;
 }
 
+
+// Function to list the paths a view shows, in display order
+std::vector<std::string> ListView::paths() const {
+    std::vector<std::string> shown;
+    shown.reserve(size());
+    for (size_t position = 0; position < size(); ++position) {
+        shown.push_back((*this)[position]);
+    }
+    return shown;
+}
+
+
+// Function to point a filtered view at the reloaded catalog, paths that left it are dropped
+void ListView::restorePaths(const std::vector<std::string>& shownPaths) {
+    if (!filtered) return;
+    std::unordered_map<std::string_view, uint32_t> catalogRows;
+    catalogRows.reserve(catalog->size());
+    for (size_t row = 0; row < catalog->size(); ++row) {
+        catalogRows.emplace((*catalog)[row], static_cast<uint32_t>(row));
+    }
+
+    std::vector<uint32_t> restored;
+    for (const std::string& path : shownPaths) {
+        auto found = catalogRows.find(path);
+        if (found != catalogRows.end()) restored.push_back(found->second);
+    }
+    if (restored.empty() || restored.size() == catalog->size()) {
+        clearFilter();
+    } else {
+        setRows(std::move(restored));
+    }
+}
+
+
+// LIVE FILTER
+
+// State of one live filter prompt, reached from the readline redisplay hook
+struct LiveFilterSession {
+    FilterList list;                 // Metadata looked up for one query is kept for the next keystrokes
+    const ListView& view;            // Queries only test the rows the view shows
+    const std::string& listType;
+    std::vector<std::pair<std::string, RowMatches>> results; // Each query's rows narrow the one before
+    std::string shownQuery;
+    bool rendered = false;
+    std::unordered_map<uint32_t, size_t> viewPositions; // Catalog row to view position, filled once for a filtered view
+
+    LiveFilterSession(const ListView& view, const std::string& listType) : list(view.base()), view(view), listType(listType) {}
+};
+
+static LiveFilterSession* liveFilterSession = nullptr;
+
+
+// Function to tell whether every match of next is also a match of previous.
+// Terms are alternatives, so only typing on at the end of the last non-empty term narrows.
+// That holds for fuzzy terms too, a longer pattern is a subsequence of fewer rows.
+// Structured queries are always evaluated in full, a longer qualifier value can match more.
+static bool queryNarrows(const std::string& previous, const std::string& next) {
+    StructuredQuery structured;
+    if (compileStructuredQuery(previous, structured, false) || compileStructuredQuery(next, structured, false)) {
+        return false;
+    }
+    return !previous.empty() && previous.back() != ';' && previous != "~" && next.size() > previous.size() &&
+           next.compare(0, previous.size(), previous) == 0 && next.find(';', previous.size()) == std::string::npos;
+}
+
+
+// Function to get the rows of a query, narrowing the last result it extends instead of scanning the list again
+static const RowMatches& liveFilterRows(LiveFilterSession& session, const std::string& query) {
+    auto& results = session.results;
+    while (!results.empty() && results.back().first != query && !queryNarrows(results.back().first, query)) {
+        results.pop_back(); // Backspace or an edit further left, fall back to an earlier query
+    }
+    if (!results.empty() && results.back().first == query) {
+        return results.back().second;
+    }
+
+    const std::vector<uint32_t>* within = results.empty() ? session.view.filteredRows() : &results.back().second.rows;
+    RowMatches matches = filterIndexRows(session.list, query, within);
+    results.emplace_back(query, std::move(matches));
+    return results.back().second;
+}
+
+
+// Function to draw the first screenful of matches above the prompt, the best ones for a fuzzy query
+static void renderLiveFilterPage(LiveFilterSession& session, const std::string& query) {
+    struct winsize window{};
+    size_t pageSize = 20;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &window) == 0 && window.ws_row > 4) {
+        pageSize = window.ws_row - 4; // Blank line, status line, prompt and one spare line
+    }
+
+    // Rows keep the numbers the view shows them under, the ones typed at the prompt
+    std::vector<std::string> page;
+    std::vector<size_t> indexes;
+    size_t total = 0;
+    if (splitQueryTerms(query, session.list.stripMarks).empty()) {
+        total = session.view.size();
+        for (size_t position = 0; position < std::min(pageSize, total); ++position) {
+            page.push_back(session.view[position]);
+            indexes.push_back(position + 1);
+        }
+    } else {
+        const RowMatches& matches = liveFilterRows(session, query);
+        total = matches.rows.size();
+        std::vector<uint32_t> rows = isFuzzyQuery(query)
+            ? topRankedRows(*session.list.index, matches, pageSize)
+            : std::vector<uint32_t>(matches.rows.begin(), matches.rows.begin() + std::min(pageSize, total));
+        if (session.view.isFiltered() && session.viewPositions.empty()) {
+            for (size_t position = 0; position < session.view.size(); ++position) {
+                session.viewPositions.emplace(session.view.catalogRow(position), position);
+            }
+        }
+        for (uint32_t row : rows) {
+            page.push_back(session.list.files[row]);
+            indexes.push_back((session.view.isFiltered() ? session.viewPositions.at(row) : row) + 1);
+        }
+    }
+
+    // A pattern that does not compile matches nothing, say why instead of counting
+    StructuredQuery structured;
+    std::string queryError = compileStructuredQuery(query, structured, session.list.stripMarks) ? structured.error : std::string();
+
+    std::cout << "\033[H\033[2J";
+    printList(page, session.listType, indexes);
+    if (!queryError.empty()) {
+        std::cout << "\n\033[1;91m" << queryError;
+    } else {
+        std::cout << "\n\033[1;94m" << total << (total == 1 ? " match" : " matches");
+        if (total > page.size()) {
+            std::cout << (isFuzzyQuery(query) ? ", best " : ", first ") << page.size() << " shown";
+        }
+    }
+    std::cout << "\033[0;1m\n" << std::flush;
+    session.rendered = true;
+}
+
+
+// Function to redraw the page whenever the typed query changes, then let readline draw the prompt line
+static void liveFilterRedisplay() {
+    LiveFilterSession& session = *liveFilterSession;
+    std::string query(rl_line_buffer, rl_end);
+    if (query != session.shownQuery || !session.rendered) {
+        session.shownQuery = query;
+        renderLiveFilterPage(session, query);
+        rl_on_new_line();
+    }
+    rl_redisplay();
+}
+
+
+// Function to read filter terms while showing the matches of the terms typed so far
+char* readLiveFilterQuery(const std::string& prompt, const ListView& view, const std::string& listType, bool& pageShown) {
+    pageShown = false;
+    if (!loadFilterRules().liveFilter || !isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO)) {
+        return readline(prompt.c_str());
+    }
+
+    LiveFilterSession session(view, listType);
+
+    liveFilterSession = &session;
+    rl_voidfunc_t* previousRedisplay = rl_redisplay_function;
+    rl_redisplay_function = liveFilterRedisplay;
+    char* input = readline(prompt.c_str());
+    rl_redisplay_function = previousRedisplay;
+    liveFilterSession = nullptr;
+
+    // The screen now holds the last page instead of the list, the caller redraws it
+    pageShown = session.rendered;
+    return input;
+}
@@ -1,6 +1,9 @@
 // SPDX-License-Identifier: GNU General Public License v3.0 or later
 
 #include "../headers.h"
+#include "../metaio.h"
+#include "../search.h"
+#include "../mounttable.h"
 
 
 // For storing isoFiles in RAM
@@ -13,9 +16,8 @@ void selectForIsoFiles(const std::string& operation, bool& historyPattern, int&
     rl_bind_key('\t', prevent_clear_screen_and_tab_completion);
     
     std::set<std::string> operationFiles, skippedMessages, operationFails, uniqueErrorMessages;
-    std::vector<std::string> filteredFiles, isoDirs;
+    std::vector<std::string> isoDirs;
     globalIsoFileList.reserve(100);
-    bool isFiltered = false;
     bool needsClrScrn = true;
     bool umountMvRmBreak = false;
     
@@ -29,6 +31,9 @@ void selectForIsoFiles(const std::string& operation, bool& historyPattern, int&
     bool isMount = (operation == "mount");
     bool isUnmount = (operation == "umount");
     bool promptFlag = false; // PromptFlag for cache refresh, defaults to false for move and other operations
+
+    // Filters keep row ids of the sorted list instead of copies of its paths
+    ListView view(isUnmount ? isoDirs : globalIsoFileList);
     
     while (true) {
         // Verbose output is to be disabled unless specified by progressbar function downstream
@@ -41,18 +46,18 @@ void selectForIsoFiles(const std::string& operation, bool& historyPattern, int&
 
         if (needsClrScrn && !isUnmount) {
 			umountMvRmBreak = false;
-            if (!clearAndLoadFiles(filteredFiles, isFiltered)) break;
+            if (!clearAndLoadFiles(view)) break;
             std::cout << "\n\n";
         } else if (needsClrScrn && isUnmount) {
 			umountMvRmBreak = false;
-            if (!loadAndDisplayMountedISOs(isoDirs, filteredFiles, isFiltered)) break;
+            if (!loadAndDisplayMountedISOs(isoDirs, view)) break;
             std::cout << "\n\n";
 		}
         
         // Move the cursor up 1 line and clear them
         std::cout << "\033[1A\033[K";
 
-        std::string prompt = isFiltered 
+        std::string prompt = view.isFiltered() 
             ? "\001\033[1;96m\002Filtered \001\033[1;92m\002ISO\001\033[1;94m\002 ↵ for \001" + operationColor + "\002" + operation + 
               "\001\033[1;94m\002, ? ↵ for help, ↵ to return:\001\033[0;1m\002 "
             : "\001\033[1;92m\002ISO\001\033[1;94m\002 ↵ for \001" + operationColor + "\002" + operation + 
@@ -76,8 +81,8 @@ void selectForIsoFiles(const std::string& operation, bool& historyPattern, int&
         }
 
         if (inputString.empty()) {
-            if (isFiltered) {
-                isFiltered = false;
+            if (view.isFiltered()) {
+                view.clearFilter();
                 continue;
             } else {
                 return;
@@ -99,12 +104,15 @@ void selectForIsoFiles(const std::string& operation, bool& historyPattern, int&
                 // Generate prompt
 				std::string filterPrompt = "\001\033[38;5;94m\002FilterTerms\001\033[1;94m\002 ↵ for \001" + operationColor + "\002" + operation + 
                                            " \001\033[1;94m\002(multi-term separator: \001\033[1;93m\002;\001\033[1;94m\002), ↵ to return: \001\033[0;1m\002";
-                std::unique_ptr<char, decltype(&std::free)> searchQuery(readline(filterPrompt.c_str()), &std::free);
+
+                // Matches are shown while typing, the list is redrawn afterwards if they replaced it
+                bool pageShown = false;
+                std::unique_ptr<char, decltype(&std::free)> searchQuery(readLiveFilterQuery(filterPrompt, view, isUnmount ? "MOUNTED_ISOS" : "ISO_FILES", pageShown), &std::free);
 
                 if (!searchQuery || searchQuery.get()[0] == '\0' || strcmp(searchQuery.get(), "/") == 0) {
                     historyPattern = false;
                     clear_history();
-                    if (isFiltered) {
+                    if (view.isFiltered() || pageShown) {
                         needsClrScrn = true;
                     } else {
                         needsClrScrn = false;
@@ -113,27 +121,21 @@ void selectForIsoFiles(const std::string& operation, bool& historyPattern, int&
                 }
 
                 std::string inputSearch(searchQuery.get());
-                
-                // Decide the current list to filter
-                std::vector<std::string>& currentFiles = !isUnmount 
-				? (isFiltered ? filteredFiles : globalIsoFileList)
-				: (isFiltered ? filteredFiles : isoDirs);
 
-                // Apply the filter on the current list
-                auto newFilteredFiles = filterFiles(currentFiles, inputSearch);
-                sortFilesCaseInsensitive(newFilteredFiles);
+                // Filter the rows shown, they stay in list order and fuzzy matches stay ranked best first
+                std::vector<uint32_t> matchedRows = filterRows(view, inputSearch);
 
-                if ((newFilteredFiles.size() == globalIsoFileList.size() && isMount) || (newFilteredFiles.size() == isoDirs.size() && isUnmount)) {
-                    isFiltered = false;
+                if (matchedRows.size() == view.base().size()) {
+                    view.clearFilter();
+                    needsClrScrn = needsClrScrn || pageShown;
                     break;
                 }
 
-                if (!newFilteredFiles.empty()) {
+                if (!matchedRows.empty()) {
                     add_history(searchQuery.get());
                     saveHistory(historyPattern);
                     needsClrScrn = true;
-						filteredFiles = std::move(newFilteredFiles);
-                    isFiltered = true;
+                    view.setRows(std::move(matchedRows));
                     historyPattern = false;
 					clear_history();
                     break;
@@ -142,41 +144,36 @@ void selectForIsoFiles(const std::string& operation, bool& historyPattern, int&
                 clear_history();
             }
         } else {
-			std::vector<std::string>& currentFiles = isFiltered 
-			? filteredFiles 
-			: (!isUnmount ? globalIsoFileList : isoDirs);
-
             clearScrollBuffer();
             needsClrScrn = true;
 
             if (isMount && inputString == "00") {
                 // Special case for mounting all files
                 std::cout << "\033[0;1m";
-                currentFiles = globalIsoFileList;
-                processAndMountIsoFiles(inputString, currentFiles, operationFiles, skippedMessages, operationFails, uniqueErrorMessages, verbose);
+                processAndMountIsoFiles(inputString, ListView(globalIsoFileList), operationFiles, skippedMessages, operationFails, uniqueErrorMessages, verbose);
             } else if (isMount){
 				clearScrollBuffer();
                 needsClrScrn = true;
                 std::cout << "\033[0;1m";
-					processAndMountIsoFiles(inputString, currentFiles, operationFiles, skippedMessages, operationFails, uniqueErrorMessages, verbose);
+					processAndMountIsoFiles(inputString, view, operationFiles, skippedMessages, operationFails, uniqueErrorMessages, verbose);
 			} else if (isUnmount) {
             // Unmount-specific logic
             std::vector<std::string> selectedIsoDirs;
             
             if (inputString == "00") {
-                selectedIsoDirs = currentFiles;
+                selectedIsoDirs = view.paths();
                 umountMvRmBreak = true;
             } else {
                 umountMvRmBreak = true;
             }
             
-			prepareUnmount(inputString, selectedIsoDirs, currentFiles, operationFiles, operationFails, uniqueErrorMessages, umountMvRmBreak, verbose);
+			prepareUnmount(inputString, selectedIsoDirs, view, operationFiles, operationFails, uniqueErrorMessages, umountMvRmBreak, verbose);
             needsClrScrn = true;
                  
         } else {
             // Generic operation processing for copy, move, remove
             std::cout << "\033[0;1m\n";
-            processOperationInput(inputString, currentFiles, operation, operationFiles, operationFails, uniqueErrorMessages, promptFlag, maxDepth, umountMvRmBreak, historyPattern, verbose);
+            processOperationInput(inputString, view, operation, operationFiles, operationFails, uniqueErrorMessages, promptFlag, maxDepth, umountMvRmBreak, historyPattern, verbose);
         }
 
             // Check and print results
@@ -198,14 +195,14 @@ void selectForIsoFiles(const std::string& operation, bool& historyPattern, int&
             }
 
             // Additional logic for non-mount operations
-            if ((process == "mv" || process == "rm" || process == "umount") && isFiltered && umountMvRmBreak) {
+            if ((process == "mv" || process == "rm" || process == "umount") && view.isFiltered() && umountMvRmBreak) {
                 historyPattern = false;
                 clear_history();
-                isFiltered = false;
+                view.clearFilter();
                 needsClrScrn = true;
             }
 
-            if (currentFiles.empty()) {
+            if (view.empty()) {
                 clearScrollBuffer();
                 needsClrScrn = true;
                 std::cout << "\n\033[1;93mNo ISO available for " << operation << ".\033[0m\n\n";
@@ -219,7 +216,7 @@ void selectForIsoFiles(const std::string& operation, bool& historyPattern, int&
 
 
 // General function to tokenize input strings
-void tokenizeInput(const std::string& input, std::vector<std::string>& isoFiles, std::set<std::string>& uniqueErrorMessages, std::set<int>& processedIndices) {
+void tokenizeInput(const std::string& input, size_t listSize, std::set<std::string>& uniqueErrorMessages, std::set<int>& processedIndices) {
     std::istringstream iss(input);
     std::string token;
 
@@ -256,7 +253,7 @@ void tokenizeInput(const std::string& input, std::vector<std::string>& isoFiles,
             }
 
             // Early range validity check
-            if ((start < 1 || static_cast<size_t>(start) > isoFiles.size() || end < 1 || static_cast<size_t>(end) > isoFiles.size()) ||
+            if ((start < 1 || static_cast<size_t>(start) > listSize || end < 1 || static_cast<size_t>(end) > listSize) ||
                 (start == 0 || end == 0)) {
                 uniqueErrorMessages.emplace("\033[1;91mInvalid range: '" + std::to_string(start) + "-" + std::to_string(end) + "'.\033[0;1m");
                 continue;
@@ -265,9 +262,9 @@ void tokenizeInput(const std::string& input, std::vector<std::string>& isoFiles,
             // Mark indices within the specified range as valid
             int step = (start <= end) ? 1 : -1;
             for (int i = start; ((start <= end) && (i <= end)) || ((start > end) && (i >= end)); i += step) {
-                if ((i >= 1) && (i <= static_cast<int>(isoFiles.size())) && processedIndices.find(i) == processedIndices.end()) {
+                if ((i >= 1) && (i <= static_cast<int>(listSize)) && processedIndices.find(i) == processedIndices.end()) {
                     processedIndices.insert(i); // Mark as processed
-                } else if ((i < 1) || (i > static_cast<int>(isoFiles.size()))) {
+                } else if ((i < 1) || (i > static_cast<int>(listSize))) {
                     uniqueErrorMessages.emplace("\033[1;91mInvalid index '" + std::to_string(i) + "'.\033[0;1m");
                 }
             }
@@ -276,7 +273,7 @@ void tokenizeInput(const std::string& input, std::vector<std::string>& isoFiles,
             int num = std::stoi(token);
 
             // Early range validity check for single index
-            if (num >= 1 && static_cast<size_t>(num) <= isoFiles.size()) {
+            if (num >= 1 && static_cast<size_t>(num) <= listSize) {
                 if (processedIndices.find(num) == processedIndices.end()) {
                     processedIndices.insert(num); // Mark index as processed
                 }
@@ -293,10 +290,9 @@ void tokenizeInput(const std::string& input, std::vector<std::string>& isoFiles,
 // Function to get the total size of files
 size_t getTotalFileSize(const std::vector<std::string>& files) {
     size_t totalSize = 0;
-    for (const auto& file : files) {
-        struct stat st;
-        if (stat(file.c_str(), &st) == 0) {
-            totalSize += st.st_size;
+    for (const PathStat& st : statPaths(files)) {
+        if (st.error == 0) {
+            totalSize += st.size;
         }
     }
     return totalSize;
@@ -422,8 +418,14 @@ void displayProgressBarWithSize(std::atomic<size_t>* completedBytes, size_t tota
 }
 
 
-// Function to print all required lists
-void printList(const std::vector<std::string>& items, const std::string& listType) {
+// Function to print a whole list
+void printList(const std::vector<std::string>& items, const std::string& listType, const std::vector<size_t>& indexes) {
+    printList(ListView(items), listType, indexes);
+}
+
+
+// Function to print all required lists, numbered 1..N unless the 1-based indexes to show are given
+void printList(const ListView& items, const std::string& listType, const std::vector<size_t>& indexes) {
     static const char* defaultColor = "\033[0m";
     static const char* bold = "\033[1m";
     static const char* reset = "\033[0m";
@@ -436,21 +438,24 @@ void printList(const std::vector<std::string>& items, const std::string& listTyp
     static const char* grayBold = "\033[38;5;245m";
         
     size_t maxIndex = items.size();
-    size_t numDigits = std::to_string(maxIndex).length();
+    size_t numDigits = std::to_string(indexes.empty() ? maxIndex : *std::max_element(indexes.begin(), indexes.end())).length();
 
     // Precompute padded index strings
     std::vector<std::string> indexStrings(maxIndex);
     for (size_t i = 0; i < maxIndex; ++i) {
-        indexStrings[i] = std::to_string(i + 1);
+        indexStrings[i] = std::to_string(indexes.empty() ? i + 1 : indexes[i]);
         indexStrings[i].insert(0, numDigits - indexStrings[i].length(), ' ');
     }
 
     std::ostringstream output;
     output << "\n"; // Initial newline for visual spacing
 
+    // Mounted markers and source ISOs come from the mount registry, checked against the mount table
+    if (listType == "ISO_FILES" || listType == "MOUNTED_ISOS") globalMountTable.refresh();
+
     for (size_t i = 0; i < items.size(); ++i) {
         const char* sequenceColor = (i % 2 == 0) ? red : green;
-        std::string directory, filename, displayPath, displayHash;
+        std::string directory, filename, displayPath, displayHash, sourceIso;
 
         if (listType == "ISO_FILES") {
             auto [dir, fname] = extractDirectoryAndFilename(items[i]);
@@ -480,6 +485,7 @@ void printList(const std::vector<std::string>& items, const std::string& listTyp
 				// If no tilde is found, set displayHash to an empty string (or handle it as needed)
 				displayHash = "";
 			}
+			globalMountRegistry.isoFor(dirName, sourceIso);
 		} else if (listType == "IMAGE_FILES") {
             auto [dir, fname] = extractDirectoryAndFilename(items[i]);
 
@@ -506,11 +512,19 @@ void printList(const std::vector<std::string>& items, const std::string& listTyp
             output << sequenceColor << indexStrings[i] << ". "
                    << defaultColor << bold << directory
                    << defaultColor << bold << "/"
-                   << magenta << filename << defaultColor << "\n";
+                   << magenta << filename << defaultColor;
+            if (globalMountRegistry.isMounted(items[i])) {
+                output << blueBold << " [mnt]" << defaultColor;
+            }
+            output << "\n";
         } else if (listType == "MOUNTED_ISOS") {
             output << sequenceColor << indexStrings[i] << ". "
                    << blueBold << "/mnt/iso_"
-                   << magentaBold << displayPath << grayBold << displayHash << reset << "\n";
+                   << magentaBold << displayPath << grayBold << displayHash << reset;
+            if (!sourceIso.empty()) {
+                output << grayBold << " <- " << sourceIso << reset;
+            }
+            output << "\n";
         } else if (listType == "IMAGE_FILES") {
 		// Alternate sequence color like in "ISO_FILES"
 		const char* sequenceColor = (i % 2 == 0) ? red : green;
@@ -552,7 +566,10 @@ void help() {
     
     // Special commands
     std::cout << "2. Special Commands:\n"
-              << "   • Enter '/' - Filter the current list\n"
+              << "   • Enter '/' - Filter the current list, matches update as you type\n"
+              << "   • Start filter terms with '~' for fuzzy matching (e.g., '~ubu2404')\n"
+              << "   • Narrow filters by field with AND/OR/NOT (e.g., 'ext:iso size>4G NOT mounted:yes')\n"
+              << "   • Match paths by pattern with glob: or re: (e.g., 'glob:*/disc[12]/*.iso')\n"
               << "   • Enter '~' - Switch between short and full paths\n"
               << "   • Enter '?' - Show this help message\n" << std::endl;
     
@@ -568,6 +585,33 @@ bool toggleFullList = false;
 // For memory mapping string transformations
 std::unordered_map<std::string, std::string> transformationCache;
 
+// Function to read a settings file, one key=value per line and '#' for comments, keys and values trimmed
+std::vector<std::pair<std::string, std::string>> readConfigPairs(const std::string& filePath) {
+    std::vector<std::pair<std::string, std::string>> pairs;
+    std::ifstream file(filePath);
+    if (!file.is_open()) {
+        return pairs;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line[start] == '#') continue;
+
+        size_t separator = line.find('=', start);
+        if (separator == std::string::npos) continue;
+
+        std::string key = line.substr(start, separator - start);
+        std::string value = line.substr(separator + 1);
+        key.erase(key.find_last_not_of(" \t") + 1);
+        value.erase(0, value.find_first_not_of(" \t"));
+        value.erase(value.find_last_not_of(" \t\r") + 1);
+        pairs.emplace_back(std::move(key), std::move(value));
+    }
+    return pairs;
+}
+
+
 // Function to extract directory and filename from a given path
 std::pair<std::string, std::string> extractDirectoryAndFilename(std::string_view path) {
     // Use string_view for non-modifying operations
@@ -7,9 +7,15 @@
 const std::string historyFilePath = std::string(getenv("HOME")) + "/.local/share/isocmd/database/iso_commander_history_cache.txt";
 const std::string historyPatternFilePath = std::string(getenv("HOME")) + "/.local/share/isocmd/database/iso_commander_pattern_cache.txt";
 
+// Use counts and last use times of folder paths, ranks AutoImportISO roots
+const std::string frecencyFilePath = std::string(getenv("HOME")) + "/.local/share/isocmd/database/iso_commander_frecency_cache.txt";
+
 //Maximum number of history entries at a time
 const int MAX_HISTORY_LINES = 50;
 
+// Maximum number of folder paths kept in the frecency file
+const size_t MAX_FRECENCY_ENTRIES = 200;
+
 const int MAX_HISTORY_PATTERN_LINES = 25;
 
 // Function to load history from readline
@@ -129,3 +135,121 @@ void saveHistory(bool& historyPattern) {
     flock(fd, LOCK_UN);
     close(fd);
 }
+
+
+// FRECENCY
+
+struct FrecencyEntry {
+    unsigned count = 0;
+    long long lastUsed = 0; // Seconds since epoch
+};
+
+
+// Function to get the current time in seconds since epoch
+static long long nowSeconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+
+// Function to weight a use count by how long ago the path was last used
+static double frecencyScore(const FrecencyEntry& entry, long long now) {
+    long long age = now - entry.lastUsed;
+    double weight = (age < 3600) ? 4.0 : (age < 86400) ? 2.0 : (age < 604800) ? 1.0 : (age < 2592000) ? 0.5 : 0.25;
+    return entry.count * weight;
+}
+
+
+// Function to key folder paths the way AutoImportISO stores them, with a trailing slash
+static std::string frecencyKey(std::string path) {
+    if (!path.empty() && path.back() != '/') {
+        path += '/';
+    }
+    return path;
+}
+
+
+// Function to read the frecency file, one "count lastUsed path" entry per line
+static std::unordered_map<std::string, FrecencyEntry> readFrecencyEntries() {
+    std::unordered_map<std::string, FrecencyEntry> entries;
+    int fd = open(frecencyFilePath.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return entries;
+    }
+
+    if (flock(fd, LOCK_SH) == -1) {
+        close(fd);
+        return entries;
+    }
+
+    std::ifstream file(frecencyFilePath);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream iss(line);
+        FrecencyEntry entry;
+        std::string path;
+        if (iss >> entry.count >> entry.lastUsed && iss.get() == ' ' && std::getline(iss, path) && !path.empty()) {
+            entries[path] = entry;
+        }
+    }
+
+    flock(fd, LOCK_UN);
+    close(fd);
+    return entries;
+}
+
+
+// Function to record that folder paths were just imported from
+void recordPathUse(const std::vector<std::string>& paths) {
+    std::unordered_map<std::string, FrecencyEntry> entries = readFrecencyEntries();
+    long long now = nowSeconds();
+    for (const auto& path : paths) {
+        FrecencyEntry& entry = entries[frecencyKey(path)];
+        ++entry.count;
+        entry.lastUsed = now;
+    }
+
+    // Keep the highest scoring paths when the file grows past its limit
+    std::vector<std::pair<std::string, FrecencyEntry>> ranked(entries.begin(), entries.end());
+    std::sort(ranked.begin(), ranked.end(), [now](const auto& a, const auto& b) {
+        return frecencyScore(a.second, now) > frecencyScore(b.second, now);
+    });
+    if (ranked.size() > MAX_FRECENCY_ENTRIES) {
+        ranked.resize(MAX_FRECENCY_ENTRIES);
+    }
+
+    std::filesystem::path dirPath = std::filesystem::path(frecencyFilePath).parent_path();
+    if (!std::filesystem::exists(dirPath) && !std::filesystem::create_directories(dirPath)) {
+        return;
+    }
+
+    // Truncate only after the lock is held, so readers never see a half-written file
+    int fd = open(frecencyFilePath.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd == -1) {
+        return;
+    }
+
+    if (flock(fd, LOCK_EX) == -1) {
+        close(fd);
+        return;
+    }
+
+    std::ofstream file(frecencyFilePath, std::ios::out | std::ios::trunc);
+    for (const auto& [path, entry] : ranked) {
+        file << entry.count << ' ' << entry.lastUsed << ' ' << path << '\n';
+    }
+    file.close();
+
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+
+// Function to score folder paths by how often and how recently they were imported from
+std::unordered_map<std::string, double> loadFrecencyScores() {
+    std::unordered_map<std::string, double> scores;
+    long long now = nowSeconds();
+    for (const auto& [path, entry] : readFrecencyEntries()) {
+        scores[path] = frecencyScore(entry, now);
+    }
+    return scores;
+}
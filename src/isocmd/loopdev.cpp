@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#include "../headers.h"
+#include "../loopdev.h"
+#include "../threadpool.h"
+#include <linux/loop.h>
+#include <sys/ioctl.h>
+
+
+LoopDevicePool::LoopDevicePool(size_t batchSize) {
+    controlFd = open("/dev/loop-control", O_RDWR | O_CLOEXEC);
+    if (controlFd == -1 || batchSize <= 1) return;
+
+    // Devices above the first free one are created for the batch, so attaching only has to configure them
+    int first = ioctl(controlFd, LOOP_CTL_GET_FREE);
+    if (first < 0) return;
+    firstFree = first;
+    size_t count = std::min(batchSize, MAX_RESERVED);
+
+    std::vector<int> created(count, -1);
+    created[0] = first;
+    size_t numThreads = std::max<size_t>(1, std::min<size_t>(maxThreads, count / 64));
+    size_t chunkSize = (count + numThreads - 1) / numThreads;
+    ThreadPool pool(numThreads);
+    std::vector<std::future<void>> futures;
+    for (size_t begin = 1; begin < count; begin += chunkSize) {
+        size_t end = std::min(begin + chunkSize, count);
+        futures.push_back(pool.enqueue([this, &created, first, begin, end]() {
+            for (size_t i = begin; i < end; ++i) {
+                // Existing devices may belong to someone else, only the ones created here are reserved
+                int index = ioctl(controlFd, LOOP_CTL_ADD, first + static_cast<int>(i));
+                if (index >= 0) {
+                    created[i] = index;
+                } else if (errno != EEXIST) {
+                    break;
+                }
+            }
+        }));
+    }
+    for (auto& future : futures) {
+        future.get();
+    }
+
+    for (auto it = created.rbegin(); it != created.rend(); ++it) {
+        if (*it >= 0) reserved.push_back(*it);
+    }
+}
+
+
+LoopDevicePool::~LoopDevicePool() {
+    if (controlFd == -1) return;
+    // Remove the devices the batch did not need, they were only created for it
+    for (int index : reserved) {
+        if (index != firstFree) ioctl(controlFd, LOOP_CTL_REMOVE, index);
+    }
+    close(controlFd);
+}
+
+
+// Function to take a reserved device, or the kernel's next free one once the reservation is used up
+int LoopDevicePool::takeDevice() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!reserved.empty()) {
+            int index = reserved.back();
+            reserved.pop_back();
+            return index;
+        }
+    }
+    return ioctl(controlFd, LOOP_CTL_GET_FREE);
+}
+
+
+// Function to attach an image to a loop device with a single LOOP_CONFIGURE call
+int LoopDevicePool::attach(const std::string& image, std::string& devicePath) {
+    if (!available()) {
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    int backingFd = open(image.c_str(), O_RDONLY | O_CLOEXEC);
+    if (backingFd == -1) return -1;
+
+    int error = EBUSY;
+    for (int attempt = 0; attempt < MAX_ATTACH_ATTEMPTS && error == EBUSY; ++attempt) {
+        int index = takeDevice();
+        if (index < 0) {
+            error = errno;
+            break;
+        }
+
+        std::string path = "/dev/loop" + std::to_string(index);
+        int loopFd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (loopFd == -1) {
+            error = errno;
+            continue;
+        }
+
+        struct loop_config config = {};
+        config.fd = static_cast<__u32>(backingFd);
+        config.info.lo_flags = LO_FLAGS_READ_ONLY | LO_FLAGS_AUTOCLEAR | LO_FLAGS_DIRECT_IO;
+        strncpy(reinterpret_cast<char*>(config.info.lo_file_name), image.c_str(), LO_NAME_SIZE - 1);
+
+        int result = ioctl(loopFd, LOOP_CONFIGURE, &config);
+        if (result == -1 && errno == EINVAL) {
+            // Backing filesystems without O_DIRECT support are attached with buffered I/O
+            config.info.lo_flags &= ~LO_FLAGS_DIRECT_IO;
+            result = ioctl(loopFd, LOOP_CONFIGURE, &config);
+        }
+        if (result == 0) {
+            close(backingFd);
+            devicePath = std::move(path);
+            return loopFd;
+        }
+
+        error = errno;
+        close(loopFd);
+        if (error == EINVAL || error == ENOTTY) {
+            configureSupported.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    close(backingFd);
+    errno = error;
+    return -1;
+}
@@ -1,6 +1,9 @@
 // SPDX-License-Identifier: GNU General Public License v3.0 or later
 
 #include "../headers.h"
+#include "../search.h"
+#include "../mounttable.h"
+#include <numeric>
 
 // Get max available CPU cores for global use, fallback is 2 cores
 unsigned int maxThreads = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 2;
@@ -77,6 +80,10 @@ int main(int argc, char *argv[]) {
 	}
 	
 	// End of automatic cache import
+	
+	// Idle unmounting and the mount cap apply to mounts left over from earlier sessions too
+	const MountRules mountRules = loadMountRules();
+	globalMountReaper.configure(mountRules.maxMounted, std::chrono::minutes(mountRules.idleUnmountMinutes));
 
     while (!exitProgram) {
 		// Calls prevent_clear_screen and tab completion
@@ -356,7 +363,7 @@ void saveAutomaticImportConfig(const std::string& filePath) {
     while (true) {
         clearScrollBuffer();
         std::string prompt = "\001\033[0;1m\002Automatically updates ISO cache in the background by scanning all stored folder paths from readline history (up to 50).\n"
-                             "\001\033[1;93m\002Note: This feature may be resource intensive for older systems and is disabled by default.\001\033[0;1m\002"
+                             "\001\033[1;93m\002Note: Runs at idle priority and pauses during mount, copy/move/remove and convert operations, it is disabled by default.\001\033[0;1m\002"
                              "\n\n\001\033[1;94m\002Toggle automatic background ISO updates at every startup (\001\033[1;92m\0021\001\033[1;94m\002/\001\033[1;91m\0020\001\033[1;94m\002), or \001\033[1;93m\002anyKey\001\033[1;94m\002 ↵ to return: \001\033[0;1m\002";
         std::unique_ptr<char, decltype(&std::free)> input(readline(prompt.c_str()), &std::free);
         std::string mainInputString(input.get());
@@ -506,13 +513,54 @@ bool isDirectoryEmpty(const std::string& path) {
 }
 
 
-// Sorts items in a case-insensitive manner
+// Sorts items in a case-insensitive manner, accented letters next to their base letters.
+// Every item is folded once into a key, most comparisons are settled by 8 key bytes held next to the key.
 void sortFilesCaseInsensitive(std::vector<std::string>& files) {
-    std::sort(files.begin(), files.end(), 
-        [](const std::string& a, const std::string& b) {
-            return strcasecmp(a.c_str(), b.c_str()) < 0;
+    struct SortKey {
+        uint64_t head;      // Big-endian key bytes after the prefix all keys share
+        size_t offset;
+        uint32_t length;
+        uint32_t item;
+    };
+    std::string keyBytes;
+    std::vector<SortKey> keys;
+    keys.reserve(files.size());
+    for (size_t item = 0; item < files.size(); ++item) {
+        size_t offset = keyBytes.size();
+        appendFolded(files[item], keyBytes, true);
+        keys.push_back({0, offset, static_cast<uint32_t>(keyBytes.size() - offset), static_cast<uint32_t>(item)});
+    }
+    if (keys.size() < 2) return;
+
+    const char* bytes = keyBytes.data();
+    size_t shared = keys[0].length;
+    for (const SortKey& key : keys) {
+        shared = std::min<size_t>(shared, key.length);
+        size_t same = 0;
+        while (same < shared && bytes[key.offset + same] == bytes[keys[0].offset + same]) ++same;
+        shared = same;
+    }
+    for (SortKey& key : keys) {
+        for (size_t i = shared; i < shared + 8; ++i) {
+            key.head = (key.head << 8) | (i < key.length ? static_cast<unsigned char>(bytes[key.offset + i]) : 0);
         }
-    );
+    }
+
+    // Items with equal keys are ordered by their raw bytes, so the order does not depend on the input order
+    std::sort(keys.begin(), keys.end(), [&](const SortKey& a, const SortKey& b) {
+        if (a.head != b.head) return a.head < b.head;
+        int compared = std::memcmp(bytes + a.offset, bytes + b.offset, std::min(a.length, b.length));
+        if (compared != 0) return compared < 0;
+        if (a.length != b.length) return a.length < b.length;
+        return files[a.item] < files[b.item];
+    });
+
+    std::vector<std::string> sorted;
+    sorted.reserve(files.size());
+    for (const SortKey& key : keys) {
+        sorted.push_back(std::move(files[key.item]));
+    }
+    files.swap(sorted);
 }
 
 
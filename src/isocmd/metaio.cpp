@@ -0,0 +1,282 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#include "../headers.h"
+#include "../metaio.h"
+#include "../scan.h"
+#include "../threadpool.h"
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+
+// Batches smaller than this are cheaper as plain fstatat calls than as a ring round trip
+static constexpr size_t MIN_RING_BATCH = 4;
+
+// Largest depth accepted from the config, keeps the locked ring memory small
+static constexpr unsigned MAX_RING_DEPTH = 4096;
+
+
+// Function to fill a PathStat from a plain stat result
+static PathStat pathStatFromStat(int result, const struct stat& st) {
+    PathStat out;
+    if (result == -1) {
+        out.error = errno;
+        return out;
+    }
+    out.error = 0;
+    out.mode = st.st_mode;
+    out.size = static_cast<uint64_t>(st.st_size);
+    out.dev = st.st_dev;
+    out.ino = st.st_ino;
+    out.mtime = static_cast<int64_t>(st.st_mtime);
+    return out;
+}
+
+
+MetadataRing::MetadataRing(unsigned depth) : depth(std::min(depth, MAX_RING_DEPTH)) {
+    if (this->depth > 0 && !setup()) {
+        teardown();
+    }
+}
+
+
+MetadataRing::~MetadataRing() {
+    teardown();
+}
+
+
+// Function to create the ring and map its queues, no liburing needed
+bool MetadataRing::setup() {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    ringFd = static_cast<int>(syscall(__NR_io_uring_setup, depth, &params));
+    if (ringFd == -1) {
+        return false; // ENOSYS on old kernels, EPERM under seccomp or io_uring_disabled
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES));
+    if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqes == MAP_FAILED) {
+        return false;
+    }
+
+    char* sq = static_cast<char*>(sqRing);
+    sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+    char* cq = static_cast<char*>(cqRing);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // The ring may be rounded up, but never more than depth requests are queued
+    depth = std::min(depth, params.sq_entries);
+    return supportsStatx();
+}
+
+
+// Function to unmap the queues and close the ring
+void MetadataRing::teardown() {
+    if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+    if (cqRing != MAP_FAILED) munmap(cqRing, cqRingSize);
+    if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+    sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    cqRing = MAP_FAILED;
+    sqRing = MAP_FAILED;
+    if (ringFd != -1) {
+        close(ringFd);
+        ringFd = -1;
+    }
+}
+
+
+// Function to check that the running kernel implements IORING_OP_STATX
+bool MetadataRing::supportsStatx() {
+    constexpr size_t opCount = IORING_OP_STATX + 1;
+    std::vector<char> storage(sizeof(io_uring_probe) + opCount * sizeof(io_uring_probe_op), 0);
+    auto* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+
+    if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, opCount) < 0) {
+        return false;
+    }
+    return probe->last_op >= IORING_OP_STATX && (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED);
+}
+
+
+// Function to submit queued requests and optionally wait for completions
+int MetadataRing::enter(unsigned toSubmit, unsigned minComplete) {
+    while (true) {
+        long ret = syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, minComplete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+        if (ret >= 0 || errno != EINTR) {
+            return static_cast<int>(ret);
+        }
+    }
+}
+
+
+// Function to consume the completions posted so far, returns how many were handled
+template <typename Handler>
+unsigned MetadataRing::reapCompletions(Handler&& handle) {
+    unsigned head = *cqHead;
+    unsigned cqTailValue = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    unsigned reaped = 0;
+    while (head != cqTailValue) {
+        const io_uring_cqe& cqe = cqes[head & *cqMask];
+        handle(static_cast<unsigned>(cqe.user_data), cqe.res);
+        ++head;
+        ++reaped;
+    }
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    return reaped;
+}
+
+
+// Function to give up a ring that failed midway. Requests the kernel already took still write into their
+// statx buffers, so they are waited for; if even that fails the buffers are never freed.
+void MetadataRing::abandonBatch(std::vector<struct statx>& buffers, unsigned inFlight) {
+    while (inFlight > 0 && enter(0, 1) >= 0) {
+        inFlight -= reapCompletions([](unsigned, int) {});
+    }
+    if (inFlight > 0) {
+        new std::vector<struct statx>(std::move(buffers)); // Deliberately leaked, see above
+    }
+    teardown(); // Broken ring, this thread stays on plain stat calls from now on
+}
+
+
+// Function to stat a batch of names with a sliding window of in-flight requests
+bool MetadataRing::statBatch(int dirFd, const std::vector<const char*>& names, int flags, std::vector<PathStat>& results) {
+    results.assign(names.size(), PathStat{});
+    if (!available()) return false;
+
+    // Each in-flight request owns one statx buffer, freed slots are refilled right away
+    std::vector<struct statx> buffers(depth);
+    std::vector<size_t> owner(depth);
+    std::vector<unsigned> freeSlots(depth);
+    for (unsigned i = 0; i < depth; ++i) {
+        freeSlots[i] = depth - 1 - i;
+    }
+
+    size_t next = 0;
+    unsigned queued = 0;    // Written to the SQ but not yet taken by the kernel
+    unsigned inFlight = 0;  // Taken by the kernel, completion pending
+
+    while (next < names.size() || queued > 0 || inFlight > 0) {
+        unsigned tail = *sqTail;
+        while (next < names.size() && !freeSlots.empty()) {
+            unsigned slot = freeSlots.back();
+            freeSlots.pop_back();
+            owner[slot] = next;
+
+            unsigned index = tail & *sqMask;
+            io_uring_sqe* sqe = &sqes[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = dirFd;
+            sqe->addr = reinterpret_cast<uint64_t>(names[next]);
+            sqe->len = STATX_TYPE | STATX_MODE | STATX_INO | STATX_SIZE | STATX_MTIME;
+            sqe->off = reinterpret_cast<uint64_t>(&buffers[slot]);
+            sqe->statx_flags = static_cast<uint32_t>(flags);
+            sqe->user_data = slot;
+            sqArray[index] = index;
+
+            ++tail;
+            ++next;
+            ++queued;
+        }
+        __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+        int submitted = enter(queued, 1); // Retries EINTR itself
+        if (submitted < 0) {
+            if (errno != EAGAIN && errno != EBUSY) {
+                abandonBatch(buffers, inFlight);
+                return false;
+            }
+            submitted = 0;
+        }
+        queued -= static_cast<unsigned>(submitted);
+        inFlight += static_cast<unsigned>(submitted);
+
+        inFlight -= reapCompletions([&](unsigned slot, int res) {
+            PathStat& out = results[owner[slot]];
+            if (res < 0) {
+                out.error = -res;
+            } else {
+                const struct statx& stx = buffers[slot];
+                out.error = 0;
+                out.mode = stx.stx_mode;
+                out.size = stx.stx_size;
+                out.dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+                out.ino = static_cast<ino_t>(stx.stx_ino);
+                out.mtime = stx.stx_mtime.tv_sec;
+            }
+            freeSlots.push_back(slot);
+        });
+    }
+    return true;
+}
+
+
+// Function to get the calling thread's ring
+MetadataRing& threadMetadataRing() {
+    thread_local MetadataRing ring(loadScanRules().ioUringDepth);
+    return ring;
+}
+
+
+// Function to stat names relative to a directory from the calling thread
+void statNamesAt(int dirFd, const std::vector<const char*>& names, int flags, std::vector<PathStat>& results) {
+    if (names.size() >= MIN_RING_BATCH && threadMetadataRing().statBatch(dirFd, names, flags, results)) {
+        return;
+    }
+
+    results.assign(names.size(), PathStat{});
+    for (size_t i = 0; i < names.size(); ++i) {
+        struct stat st;
+        results[i] = pathStatFromStat(fstatat(dirFd, names[i], &st, flags), st);
+    }
+}
+
+
+// Function to stat absolute paths with as many requests in flight as the device allows
+std::vector<PathStat> statPaths(const std::vector<std::string>& paths) {
+    std::vector<PathStat> results;
+    std::vector<const char*> names;
+    names.reserve(paths.size());
+    for (const auto& path : paths) {
+        names.push_back(path.c_str());
+    }
+
+    if (names.size() >= MIN_RING_BATCH && threadMetadataRing().statBatch(AT_FDCWD, names, 0, results)) {
+        return results;
+    }
+
+    // Without io_uring every blocking stat needs its own thread to overlap device latency
+    results.assign(paths.size(), PathStat{});
+    const size_t numThreads = std::max<size_t>(1, std::min<size_t>(maxThreads, paths.size()));
+    const size_t chunkSize = (paths.size() + numThreads - 1) / numThreads;
+
+    ThreadPool pool(numThreads);
+    std::vector<std::future<void>> futures;
+    for (size_t begin = 0; begin < paths.size(); begin += chunkSize) {
+        size_t end = std::min(begin + chunkSize, paths.size());
+        futures.push_back(pool.enqueue([&paths, &results, begin, end]() {
+            for (size_t i = begin; i < end; ++i) {
+                struct stat st;
+                results[i] = pathStatFromStat(stat(paths[i].c_str(), &st), st);
+            }
+        }));
+    }
+    for (auto& future : futures) {
+        future.get();
+    }
+    return results;
+}
@@ -2,43 +2,206 @@
 
 #include "../headers.h"
 #include "../threadpool.h"
+#include "../scan.h"
+#include "../search.h"
+#include "../loopdev.h"
+#include "../mounttable.h"
+#include <sys/mount.h>
 
 
-// Function to check if a mountpoint isAlreadyMounted
+const std::string mountRulesFilePath = std::string(getenv("HOME")) + "/.config/isocmd/config/iso_commander_mount.txt";
+
+
+// Function to load mount settings, defaults are used for missing keys
+MountRules loadMountRules() {
+    MountRules rules;
+    for (const auto& [key, value] : readConfigPairs(mountRulesFilePath)) {
+        if (key == "new_mount_api") {
+            rules.newMountApi = (value == "1");
+        } else if (key == "max_mounted" || key == "idle_unmount_minutes") {
+            try {
+                int number = std::max(std::stoi(value), 0);
+                if (key == "max_mounted") {
+                    rules.maxMounted = static_cast<size_t>(number);
+                } else {
+                    rules.idleUnmountMinutes = static_cast<unsigned>(number);
+                }
+            } catch (const std::exception&) {
+                // Keep the default on malformed values
+            }
+        }
+    }
+    return rules;
+}
+
+
+// Function to check if a mountpoint isAlreadyMounted, as of the last refresh of the shared mount table
 bool isAlreadyMounted(const std::string& mountPoint) {
-    struct statvfs vfs;
-    if (statvfs(mountPoint.c_str(), &vfs) != 0) {
-        return false; // Error or doesn't exist
+    return globalMountTable.contains(mountPoint);
+}
+
+
+// Probe results of regular files, valid while the file keeps its identity, size and mtime
+namespace {
+    struct CachedProbe {
+        dev_t dev;
+        ino_t ino;
+        off_t size;
+        struct timespec mtime;
+        VolumeProbe probe;
+    };
+
+    std::mutex probeCacheMutex;
+    std::unordered_map<std::string, CachedProbe> probeCache;
+
+    constexpr size_t SECTOR_SIZE = 2048;
+    constexpr size_t DESCRIPTOR_FIRST_SECTOR = 16;  // ISO 9660 and UDF volume recognition sequence
+    constexpr size_t DESCRIPTOR_SECTORS = 16;
+    constexpr size_t HFSPLUS_HEADER_OFFSET = 1024;
+    constexpr off_t UDF_ANCHOR_OFFSET = 256 * SECTOR_SIZE;
+}
+
+
+// Function to read the filesystem type and volume label of an image from its on-disk descriptors.
+// The HFS+ header and the volume descriptors share the first 64 KiB, read with one pread;
+// the UDF anchor is only read when the recognition sequence names UDF.
+static VolumeProbe readVolumeDescriptors(int fd) {
+    VolumeProbe probe;
+    std::vector<char> head(SECTOR_SIZE * (DESCRIPTOR_FIRST_SECTOR + DESCRIPTOR_SECTORS));
+    ssize_t bytesRead = pread(fd, head.data(), head.size(), 0);
+    if (bytesRead <= 0) return probe;
+
+    bool hasIso9660 = false;
+    bool hasUdf = false;
+    size_t sectorsRead = static_cast<size_t>(bytesRead) / SECTOR_SIZE;
+    for (size_t sector = DESCRIPTOR_FIRST_SECTOR; sector < sectorsRead; ++sector) {
+        const char* descriptor = head.data() + sector * SECTOR_SIZE;
+        if (std::memcmp(descriptor + 1, "CD001", 5) == 0) {
+            if (descriptor[0] == 1 && !hasIso9660) {
+                hasIso9660 = true;
+                probe.label.assign(descriptor + 40, 32);
+                probe.label.erase(probe.label.find_last_not_of(std::string(" \0", 2)) + 1);
+            }
+        } else if (std::memcmp(descriptor + 1, "NSR02", 5) == 0 || std::memcmp(descriptor + 1, "NSR03", 5) == 0) {
+            hasUdf = true;
+        } else if (std::memcmp(descriptor + 1, "BEA01", 5) != 0 && std::memcmp(descriptor + 1, "TEA01", 5) != 0) {
+            break; // End of the recognition sequence
+        }
+    }
+
+    // The anchor volume descriptor pointer: tag identifier 2 recorded at its own location
+    if (hasUdf) {
+        unsigned char anchor[16];
+        hasUdf = pread(fd, anchor, sizeof(anchor), UDF_ANCHOR_OFFSET) == static_cast<ssize_t>(sizeof(anchor)) &&
+                 (anchor[0] | anchor[1] << 8) == 2 &&
+                 (anchor[12] | anchor[13] << 8 | anchor[14] << 16 | static_cast<uint32_t>(anchor[15]) << 24) == 256;
     }
 
-    // Check if it's a mount point
-    return (vfs.f_flag & ST_NODEV) == 0;
+    // Hybrid discs carry a stub ISO 9660 tree next to the UDF one, the UDF side holds the content,
+    // the ISO 9660 side still mounts them on kernels built without udf
+    if (hasUdf) {
+        probe.fsType = "udf";
+        if (hasIso9660) probe.fallbackFsType = "iso9660";
+    } else if (hasIso9660) {
+        probe.fsType = "iso9660";
+    } else if (static_cast<size_t>(bytesRead) >= HFSPLUS_HEADER_OFFSET + 2 &&
+               (std::memcmp(head.data() + HFSPLUS_HEADER_OFFSET, "H+", 2) == 0 || std::memcmp(head.data() + HFSPLUS_HEADER_OFFSET, "HX", 2) == 0)) {
+        probe.fsType = "hfsplus";
+    }
+    return probe;
+}
+
+
+// Function to probe an image or device for its filesystem type and volume label, cached per regular file
+VolumeProbe probeIsoVolume(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return VolumeProbe();
+
+    struct stat st;
+    bool cacheable = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    if (cacheable) {
+        std::lock_guard<std::mutex> lock(probeCacheMutex);
+        auto cached = probeCache.find(path);
+        if (cached != probeCache.end() && cached->second.dev == st.st_dev && cached->second.ino == st.st_ino &&
+            cached->second.size == st.st_size && cached->second.mtime.tv_sec == st.st_mtim.tv_sec &&
+            cached->second.mtime.tv_nsec == st.st_mtim.tv_nsec) {
+            close(fd);
+            return cached->second.probe;
+        }
+    }
+
+    VolumeProbe probe = readVolumeDescriptors(fd);
+    close(fd);
+
+    // Loop devices change content without changing identity, only files are cached
+    if (cacheable) {
+        std::lock_guard<std::mutex> lock(probeCacheMutex);
+        probeCache[path] = CachedProbe{st.st_dev, st.st_ino, st.st_size, st.st_mtim, probe};
+    }
+    return probe;
+}
+
+
+// Function to get the mount point of an ISO: its stem plus a short stable hash of the full path
+std::string isoMountPoint(const std::string& isoFile) {
+    return globalMountRegistry.mountPointFor(isoFile);
+}
+
+
+// Cleared once the kernel turns out not to have the fsopen mount API (Linux < 5.2)
+static std::atomic<bool> fsContextAvailable{true};
+
+
+// Function to mount a block device read-only through fsopen, fsconfig, fsmount and move_mount.
+// The superblock is created on the calling thread without the namespace lock, so workers build theirs
+// in parallel, and only the final move_mount attaches it. Returns 0, or -1 with errno, ENOSYS when the API is missing.
+static int mountWithFsContext(const std::string& device, const std::string& fsType, const std::string& mountPoint) {
+#ifdef FSOPEN_CLOEXEC
+    int fsFd = fsopen(fsType.c_str(), FSOPEN_CLOEXEC);
+    if (fsFd == -1) {
+        if (errno == ENOSYS) fsContextAvailable.store(false, std::memory_order_relaxed);
+        return -1;
+    }
+
+    int mountFd = -1;
+    if (fsconfig(fsFd, FSCONFIG_SET_STRING, "source", device.c_str(), 0) == 0 &&
+        fsconfig(fsFd, FSCONFIG_SET_FLAG, "ro", nullptr, 0) == 0 &&
+        fsconfig(fsFd, FSCONFIG_CMD_CREATE, nullptr, nullptr, 0) == 0) {
+        mountFd = fsmount(fsFd, FSMOUNT_CLOEXEC, MOUNT_ATTR_RDONLY);
+    }
+    int error = errno;
+    close(fsFd);
+    if (mountFd == -1) {
+        errno = error == ENOSYS ? EINVAL : error; // Only fsopen itself reports a missing API
+        return -1;
+    }
+
+    int result = move_mount(mountFd, "", AT_FDCWD, mountPoint.c_str(), MOVE_MOUNT_F_EMPTY_PATH);
+    error = errno;
+    close(mountFd);
+    errno = error == ENOSYS ? EINVAL : error;
+    return result;
+#else
+    (void)device;
+    (void)fsType;
+    (void)mountPoint;
+    errno = ENOSYS;
+    return -1;
+#endif
 }
 
 
 // Function to mount selected ISO files called from processAndMountIsoFiles
-void mountIsoFiles(const std::vector<std::string>& isoFiles, std::set<std::string>& mountedFiles, std::set<std::string>& skippedMessages, std::set<std::string>& mountedFails) {
+void mountIsoFiles(const std::vector<std::string>& isoFiles, std::set<std::string>& mountedFiles, std::set<std::string>& skippedMessages, std::set<std::string>& mountedFails, LoopDevicePool* loopPool, bool useFsContext) {
     for (const auto& isoFile : isoFiles) {
         namespace fs = std::filesystem;
         fs::path isoPath(isoFile);
 
         // Prepare path and naming information
-        std::string isoFileName = isoPath.stem().string();
         auto [isoDirectory, isoFilename] = extractDirectoryAndFilename(isoFile);
 
-        // Generate unique hash for mount point
-        std::hash<std::string> hasher;
-        size_t hashValue = hasher(isoFile);
-        const std::string base36Chars = "0123456789abcdefghijklmnopqrstuvwxyz";
-        std::string shortHash;
-        for (int i = 0; i < 5; ++i) {
-            shortHash += base36Chars[hashValue % 36];
-            hashValue /= 36;
-        }
-
         // Create unique mount point and identifiers
-        std::string uniqueId = isoFileName + "~" + shortHash;
-        std::string mountPoint = "/mnt/iso_" + uniqueId;
+        std::string mountPoint = isoMountPoint(isoFile);
         auto [mountisoDirectory, mountisoFilename] = extractDirectoryAndFilename(mountPoint);
 
         // Validation checks with centralized error handling
@@ -79,6 +242,13 @@ void mountIsoFiles(const std::vector<std::string>& isoFiles, std::set<std::strin
             continue;
         }
 
+        // Claim the mount point in the registry, a name taken by another ISO is replaced by a free one
+        std::string registeredMountPoint = globalMountRegistry.assign(isoFile);
+        if (registeredMountPoint != mountPoint) {
+            mountPoint = registeredMountPoint;
+            std::tie(mountisoDirectory, mountisoFilename) = extractDirectoryAndFilename(mountPoint);
+        }
+
         // Create mount point directory if it doesn't exist
         if (!fs::exists(mountPoint)) {
             try {
@@ -89,60 +259,76 @@ void mountIsoFiles(const std::vector<std::string>& isoFiles, std::set<std::strin
                              << "'\033[0m\033[1;91m. Error: " << e.what() << "\033[0m";
                 
                 mountedFails.insert(errorMessage.str());
+                globalMountRegistry.release(mountPoint);
                 continue;
             }
         }
 
-        // Create libmount context
-        struct libmnt_context *ctx = mnt_new_context();
-        if (!ctx) {
-            std::stringstream errorMessage;
-            errorMessage << "\033[1;91mFailed to create mount context for: \033[1;93m'" << isoFile << "'\033[0m";
-            
-            mountedFails.insert(errorMessage.str());
-            continue;
+        // Attach a loop device of the batch's pool, libmount sets up its own when that is not possible
+        std::string loopDevice;
+        int loopFd = loopPool && loopPool->available() ? loopPool->attach(isoFile, loopDevice) : -1;
+
+        // Mount the probed filesystem directly (hybrids keep their ISO 9660 side as a fallback), images the probe does not recognise
+        // still get the kernel's own detection over the supported types
+        VolumeProbe probe = probeIsoVolume(isoFile);
+        std::string detectedFsType = probe.fsType;
+
+        bool mountSuccess = false;
+        bool mountAttempted = false;
+        if (useFsContext && loopFd != -1 && !detectedFsType.empty() && fsContextAvailable.load(std::memory_order_relaxed)) {
+            mountSuccess = mountWithFsContext(loopDevice, detectedFsType, mountPoint) == 0;
+            // ENODEV: no udf in this kernel, a hybrid mounts through its ISO 9660 side instead
+            if (!mountSuccess && errno == ENODEV && !probe.fallbackFsType.empty()) {
+                detectedFsType = probe.fallbackFsType;
+                mountSuccess = mountWithFsContext(loopDevice, detectedFsType, mountPoint) == 0;
+            }
+            mountAttempted = mountSuccess || errno != ENOSYS;
         }
 
-        // Configure mount options
-        mnt_context_set_source(ctx, isoFile.c_str());
-        mnt_context_set_target(ctx, mountPoint.c_str());
-        mnt_context_set_options(ctx, "loop,ro");
+        if (!mountAttempted) {
+            // Create libmount context
+            struct libmnt_context *ctx = mnt_new_context();
+            if (!ctx) {
+                if (loopFd != -1) close(loopFd);
+                globalMountRegistry.release(mountPoint);
+                std::stringstream errorMessage;
+                errorMessage << "\033[1;91mFailed to create mount context for: \033[1;93m'" << isoFile << "'\033[0m";
+                
+                mountedFails.insert(errorMessage.str());
+                continue;
+            }
+
+            // Configure mount options
+            mnt_context_set_source(ctx, loopFd != -1 ? loopDevice.c_str() : isoFile.c_str());
+            mnt_context_set_target(ctx, mountPoint.c_str());
+            mnt_context_set_options(ctx, loopFd != -1 ? "ro" : "loop,ro");
+            // A hybrid lists its ISO 9660 side second, libmount tries it when udf is missing
+            std::string fsTypes = detectedFsType.empty() ? "iso9660,udf,hfsplus"
+                                : probe.fallbackFsType.empty() ? detectedFsType : detectedFsType + "," + probe.fallbackFsType;
+            mnt_context_set_fstype(ctx, fsTypes.c_str());
+            if (fsTypes.find(',') != std::string::npos) detectedFsType.clear(); // Read back from the mount table below
 
-        // Set filesystem types to try
-        std::string fsTypeList = "iso9660,udf,hfsplus,rockridge,joliet,isofs";
-        mnt_context_set_fstype(ctx, fsTypeList.c_str());
+            // Attempt to mount
+            int ret = mnt_context_mount(ctx);
+            mountSuccess = (ret == 0);
 
-        // Attempt to mount
-        int ret = mnt_context_mount(ctx);
-        bool mountSuccess = (ret == 0);
+            // Cleanup mount context
+            mnt_free_context(ctx);
+        }
 
-        // Cleanup mount context
-        mnt_free_context(ctx);
+        // An autoclear loop device detaches here if the mount failed
+        if (loopFd != -1) close(loopFd);
 
-        // Filesystem type detection
-        std::string detectedFsType;
         if (mountSuccess) {
-            struct stat st;
-            if (stat(mountPoint.c_str(), &st) == 0) {
-                FILE* mountFile = fopen("/proc/mounts", "r");
-                if (mountFile) {
-                    char line[1024];
-                    while (fgets(line, sizeof(line), mountFile)) {
-                        char sourcePath[PATH_MAX];
-                        char mountPath[PATH_MAX];
-                        char fsType[256];
-                        
-                        // Parse /proc/mounts line
-                        if (sscanf(line, "%s %s %s", sourcePath, mountPath, fsType) == 3) {
-                            if (strcmp(mountPath, mountPoint.c_str()) == 0) {
-                                detectedFsType = fsType;
-                                break;
-                            }
-                        }
-                    }
-                    fclose(mountFile);
-                }
+            // Only images the probe could not classify need the kernel's answer
+            if (detectedFsType.empty()) {
+                globalMountTable.refresh();
+                MountEntry entry;
+                if (globalMountTable.find(mountPoint, entry)) detectedFsType = entry.fsType;
+            } else {
+                globalMountTable.noteMounted(mountPoint, MountEntry{loopFd != -1 ? loopDevice : isoFile, detectedFsType});
             }
+            globalMountReaper.watch(mountPoint);
 
             // Prepare mounted file information
             std::string mountedFileInfo = "\033[1mISO: \033[1;92m'" + isoDirectory + "/" + isoFilename + "'\033[0m"
@@ -164,13 +350,37 @@ void mountIsoFiles(const std::vector<std::string>& isoFiles, std::set<std::strin
             // Mount failed
             logError("{badFS}");
             fs::remove(mountPoint);
+            globalMountRegistry.release(mountPoint);
         }
     }
 }
 
 
+// Function to drop the ISOs of a selection that stay over the mount cap after idle mounts are unmounted
+static void applyMountCap(std::set<int>& indicesToProcess, const ListView& isoFiles, std::set<std::string>& mountedFails) {
+    std::unordered_set<std::string> keep; // Selected ISOs already mounted are skipped, not unmounted
+    std::vector<int> pending;
+    for (int index : indicesToProcess) {
+        std::string mountPoint = isoMountPoint(isoFiles[index - 1]);
+        if (isAlreadyMounted(mountPoint)) {
+            keep.insert(std::move(mountPoint));
+        } else {
+            pending.push_back(index);
+        }
+    }
+
+    size_t room = globalMountReaper.reserve(pending.size(), keep);
+    for (size_t i = room; i < pending.size(); ++i) {
+        auto [isoDirectory, isoFilename] = extractDirectoryAndFilename(isoFiles[pending[i] - 1]);
+        mountedFails.insert("\033[1;91mFailed to mnt: \033[1;93m'" + isoDirectory + "/" + isoFilename
+                            + "'\033[0m\033[1;91m.\033[0;1m {mountLimit}\033[0m");
+        indicesToProcess.erase(pending[i]);
+    }
+}
+
+
 // Function to process input and mount ISO files asynchronously
-void processAndMountIsoFiles(const std::string& input, std::vector<std::string>& isoFiles, std::set<std::string>& mountedFiles, std::set<std::string>& skippedMessages, std::set<std::string>& mountedFails, std::set<std::string>& uniqueErrorMessages, bool& verbose) {
+void processAndMountIsoFiles(const std::string& input, const ListView& isoFiles, std::set<std::string>& mountedFiles, std::set<std::string>& skippedMessages, std::set<std::string>& mountedFails, std::set<std::string>& uniqueErrorMessages, bool& verbose) {
     std::set<int> indicesToProcess; // To store indices parsed from the input
 
     if (input == "00") {
@@ -180,7 +390,7 @@ void processAndMountIsoFiles(const std::string& input, std::vector<std::string>&
 		}
     } else {
         // Existing tokenization logic for specific inputs
-        tokenizeInput(input, isoFiles, uniqueErrorMessages, indicesToProcess);
+        tokenizeInput(input, isoFiles.size(), uniqueErrorMessages, indicesToProcess);
         if (indicesToProcess.empty()) {
             std::cout << "\033[1;91mNo valid input provided for mount.\033[0;1m";
             return; // Exit if no valid indices are provided
@@ -188,12 +398,24 @@ void processAndMountIsoFiles(const std::string& input, std::vector<std::string>&
     }
     
     std::cout << "\n\033[0;1m Processing \033[1;92mmount\033[0;1m operations...\n";
+    globalMountTable.refresh(); // One table read for the whole batch, the mounts below are noted as they happen
+    const MountRules mountRules = loadMountRules();
+    globalMountReaper.configure(mountRules.maxMounted, std::chrono::minutes(mountRules.idleUnmountMinutes)); // Picks up config edits made since startup
+    if (mountRules.maxMounted > 0 && geteuid() == 0) {
+        applyMountCap(indicesToProcess, isoFiles, mountedFails);
+        if (indicesToProcess.empty()) {
+            globalMountRegistry.save();
+            return;
+        }
+    }
+    ForegroundActivity foreground; // AutoImportISO pauses until the mounts are done
     std::atomic<size_t> completedTasks(0); // Number of completed tasks
     std::atomic<bool> isProcessingComplete(false); // Flag to indicate processing completion
     unsigned int numThreads = std::min(static_cast<unsigned int>(indicesToProcess.size()), static_cast<unsigned int>(maxThreads));
     ThreadPool pool(numThreads); // Create a thread pool with the determined number of threads
     
     size_t totalTasks = indicesToProcess.size();
+    LoopDevicePool loopPool(geteuid() == 0 ? totalTasks : 0); // Loop devices for the whole batch, created up front
     size_t chunkSize = std::max(size_t(1), std::min(size_t(50), (totalTasks + numThreads - 1) / numThreads)); // Determine chunk size for tasks
     
     std::atomic<size_t> activeTaskCount(0); // Track the number of active tasks
@@ -218,7 +440,7 @@ void processAndMountIsoFiles(const std::string& input, std::vector<std::string>&
 				++it; // Move the iterator to the next element
 			}
         
-			mountIsoFiles(filesToMount, mountedFiles, skippedMessages, mountedFails); // Mount ISO files        
+			mountIsoFiles(filesToMount, mountedFiles, skippedMessages, mountedFails, &loopPool, mountRules.newMountApi); // Mount ISO files        
 			completedTasks.fetch_add(end - i, std::memory_order_relaxed); // Update completed tasks count
         
 			// Notify if all tasks are done
@@ -245,5 +467,6 @@ void processAndMountIsoFiles(const std::string& input, std::vector<std::string>&
     }
     isProcessingComplete.store(true, std::memory_order_release); // Set processing completion flag
     progressThread.join(); // Wait for the progress thread to finish
+    globalMountRegistry.save();
 }
 
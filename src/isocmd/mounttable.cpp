@@ -0,0 +1,555 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#include "../headers.h"
+#include "../mounttable.h"
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/fanotify.h>
+
+
+MountTable globalMountTable;
+
+
+MountTable::~MountTable() {
+    if (mountInfoFd != -1) close(mountInfoFd);
+}
+
+
+// Function to decode the octal escapes mountinfo uses for spaces, tabs, newlines and backslashes
+static std::string decodeMountField(std::string_view field) {
+    std::string decoded;
+    decoded.reserve(field.size());
+    for (size_t i = 0; i < field.size(); ++i) {
+        if (field[i] == '\\' && i + 3 < field.size() && field[i + 1] >= '0' && field[i + 1] <= '7' &&
+            field[i + 2] >= '0' && field[i + 2] <= '7' && field[i + 3] >= '0' && field[i + 3] <= '7') {
+            decoded += static_cast<char>((field[i + 1] - '0') * 64 + (field[i + 2] - '0') * 8 + (field[i + 3] - '0'));
+            i += 3;
+        } else {
+            decoded += field[i];
+        }
+    }
+    return decoded;
+}
+
+
+// Function to check whether the kernel flagged a mount table change since the last check, opens mountinfo on first use
+bool MountTable::changed() {
+    if (mountInfoFd == -1) {
+        mountInfoFd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+        return true;
+    }
+    struct pollfd pfd = {mountInfoFd, POLLPRI, 0};
+    return poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLPRI | POLLERR)) != 0;
+}
+
+
+// Function to parse mountinfo: "id parent major:minor root mountpoint options [optional...] - fstype source superoptions"
+bool MountTable::readTable(std::unordered_map<std::string, MountEntry>& table) {
+    if (mountInfoFd == -1) return false;
+
+    // The poll already consumed the change notification, a change made during this read is flagged again
+    std::string content;
+    char chunk[65536];
+    off_t offset = 0;
+    ssize_t bytesRead;
+    while ((bytesRead = pread(mountInfoFd, chunk, sizeof(chunk), offset)) > 0) {
+        content.append(chunk, static_cast<size_t>(bytesRead));
+        offset += bytesRead;
+    }
+    if (bytesRead < 0) return false;
+
+    std::string_view text(content);
+    std::vector<std::string_view> fields;
+    while (!text.empty()) {
+        size_t lineEnd = text.find('\n');
+        std::string_view line = text.substr(0, lineEnd);
+        text.remove_prefix(lineEnd == std::string_view::npos ? text.size() : lineEnd + 1);
+
+        fields.clear();
+        size_t start = 0;
+        while (start < line.size()) {
+            size_t end = line.find(' ', start);
+            if (end == std::string_view::npos) end = line.size();
+            fields.push_back(line.substr(start, end - start));
+            start = end + 1;
+        }
+
+        auto separator = std::find(fields.begin(), fields.end(), std::string_view("-"));
+        if (fields.size() < 5 || separator == fields.end() || fields.end() - separator < 3) continue;
+        // The last mount on a path hides the ones below it, later lines win
+        table[decodeMountField(fields[4])] = MountEntry{decodeMountField(separator[2]), decodeMountField(separator[1])};
+    }
+    return true;
+}
+
+
+void MountTable::refresh() {
+    std::lock_guard<std::mutex> refreshLock(refreshMutex);
+    if (!changed() && loaded) return;
+
+    std::unordered_map<std::string, MountEntry> table;
+    bool read = readTable(table);
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    if (!read) {
+        // The change notification is already consumed, so the next refresh has to re-read by itself;
+        // lookups keep the old snapshot until then
+        loaded = false;
+        return;
+    }
+    entries.swap(table);
+    loaded = true;
+}
+
+
+bool MountTable::find(const std::string& mountPoint, MountEntry& entry) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = entries.find(mountPoint);
+    if (it == entries.end()) return false;
+    entry = it->second;
+    return true;
+}
+
+
+bool MountTable::contains(const std::string& mountPoint) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return entries.count(mountPoint) > 0;
+}
+
+
+std::vector<std::string> MountTable::mountPointsWithPrefix(const std::string& prefix) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    std::vector<std::string> mountPoints;
+    for (const auto& [mountPoint, entry] : entries) {
+        if (mountPoint.compare(0, prefix.size(), prefix) == 0) mountPoints.push_back(mountPoint);
+    }
+    return mountPoints;
+}
+
+
+void MountTable::noteMounted(const std::string& mountPoint, MountEntry entry) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    entries[mountPoint] = std::move(entry);
+}
+
+
+void MountTable::noteUnmounted(const std::string& mountPoint) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    entries.erase(mountPoint);
+}
+
+
+// MOUNT REGISTRY
+
+MountRegistry globalMountRegistry;
+
+const std::string mountRegistryFilePath = std::string(getenv("HOME")) + "/.local/share/isocmd/database/iso_commander_mount_registry.txt";
+
+
+// XXH64 of a string, the same on every build and platform unlike std::hash
+static uint64_t xxh64(std::string_view data, uint64_t seed) {
+    constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+    constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+    constexpr uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+    constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+    constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+    auto rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+    auto read64 = [](const char* p) { uint64_t v; std::memcpy(&v, p, 8); return v; };
+    auto read32 = [](const char* p) { uint32_t v; std::memcpy(&v, p, 4); return static_cast<uint64_t>(v); };
+    auto round = [&](uint64_t acc, uint64_t input) { return rotl(acc + input * PRIME2, 31) * PRIME1; };
+    auto merge = [&](uint64_t acc, uint64_t val) { return (acc ^ round(0, val)) * PRIME1 + PRIME4; };
+
+    const char* p = data.data();
+    const char* end = p + data.size();
+    uint64_t hash;
+    if (data.size() >= 32) {
+        uint64_t v1 = seed + PRIME1 + PRIME2, v2 = seed + PRIME2, v3 = seed, v4 = seed - PRIME1;
+        for (; p + 32 <= end; p += 32) {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+        }
+        hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        hash = merge(merge(merge(merge(hash, v1), v2), v3), v4);
+    } else {
+        hash = seed + PRIME5;
+    }
+    hash += data.size();
+
+    for (; p + 8 <= end; p += 8) {
+        hash = rotl(hash ^ round(0, read64(p)), 27) * PRIME1 + PRIME4;
+    }
+    if (p + 4 <= end) {
+        hash = rotl(hash ^ (read32(p) * PRIME1), 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        hash = rotl(hash ^ (static_cast<unsigned char>(*p) * PRIME5), 11) * PRIME1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+
+// Function to build the mount point an ISO gets with a given hash seed: its stem plus a short hash of the full path
+std::string MountRegistry::candidate(const std::string& isoFile, uint64_t seed) {
+    std::string isoFileName = std::filesystem::path(isoFile).stem().string();
+
+    uint64_t hashValue = xxh64(isoFile, seed);
+    const char* base36Chars = "0123456789abcdefghijklmnopqrstuvwxyz";
+    std::string shortHash;
+    for (size_t i = 0; i < HASH_CHARS; ++i) {
+        shortHash += base36Chars[hashValue % 36];
+        hashValue /= 36;
+    }
+    return "/mnt/iso_" + isoFileName + "~" + shortHash;
+}
+
+
+// Function to find the first candidate not registered to another ISO, whose stem and hash collide and keeps its name
+std::string MountRegistry::freeCandidateLocked(const std::string& isoFile) const {
+    std::string mountPoint = candidate(isoFile, 0);
+    for (uint64_t seed = 1; isoFiles.count(mountPoint) > 0 && seed < MAX_SEEDS; ++seed) {
+        mountPoint = candidate(isoFile, seed);
+    }
+    return mountPoint;
+}
+
+
+// Function to read the registry once per process, dropping mount points that were unmounted meanwhile
+void MountRegistry::load() {
+    std::call_once(loadOnce, [this]() {
+        std::ifstream file(mountRegistryFilePath);
+        if (!file.is_open()) return;
+
+        globalMountTable.refresh();
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        std::string line;
+        while (std::getline(file, line)) {
+            size_t tab = line.find('\t');
+            if (tab == std::string::npos) continue;
+            std::string mountPoint = line.substr(0, tab);
+            if (!globalMountTable.contains(mountPoint)) {
+                dirty = true;
+                continue;
+            }
+            std::string isoFile = line.substr(tab + 1);
+            mountPoints[isoFile] = mountPoint;
+            isoFiles[mountPoint] = std::move(isoFile);
+        }
+    });
+}
+
+
+std::string MountRegistry::mountPointFor(const std::string& isoFile) {
+    load();
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = mountPoints.find(isoFile);
+    if (it != mountPoints.end()) return it->second;
+    return freeCandidateLocked(isoFile); // Names owned by another ISO are skipped, as assign() does
+}
+
+
+bool MountRegistry::isoFor(const std::string& mountPoint, std::string& isoFile) {
+    load();
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = isoFiles.find(mountPoint);
+    if (it == isoFiles.end()) return false;
+    isoFile = it->second;
+    return true;
+}
+
+
+std::string MountRegistry::assign(const std::string& isoFile) {
+    load();
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    auto registered = mountPoints.find(isoFile);
+    if (registered != mountPoints.end()) return registered->second;
+
+    std::string mountPoint = freeCandidateLocked(isoFile);
+    mountPoints[isoFile] = mountPoint;
+    isoFiles[mountPoint] = isoFile;
+    dirty = true;
+    return mountPoint;
+}
+
+
+void MountRegistry::release(const std::string& mountPoint) {
+    load();
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    auto it = isoFiles.find(mountPoint);
+    if (it == isoFiles.end()) return;
+    mountPoints.erase(it->second);
+    isoFiles.erase(it);
+    dirty = true;
+}
+
+
+bool MountRegistry::isMounted(const std::string& isoFile) {
+    load();
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = mountPoints.find(isoFile);
+    return it != mountPoints.end() && globalMountTable.contains(it->second);
+}
+
+
+std::vector<std::string> MountRegistry::mountedPoints() {
+    load();
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    std::vector<std::string> mounted;
+    for (const auto& [mountPoint, isoFile] : isoFiles) {
+        if (globalMountTable.contains(mountPoint)) mounted.push_back(mountPoint);
+    }
+    return mounted;
+}
+
+
+// Function to write the registry to a temporary file and rename it over the old one
+void MountRegistry::save() {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    if (!dirty) return;
+
+    std::string content;
+    for (const auto& [mountPoint, isoFile] : isoFiles) {
+        content += mountPoint;
+        content += '\t';
+        content += isoFile;
+        content += '\n';
+    }
+
+    std::filesystem::path registryPath(mountRegistryFilePath);
+    std::error_code error;
+    std::filesystem::create_directories(registryPath.parent_path(), error);
+    std::string temporaryPath = mountRegistryFilePath + ".tmp";
+    std::ofstream file(temporaryPath, std::ios::trunc);
+    if (!file.is_open()) return;
+    file << content;
+    file.close();
+    if (file && rename(temporaryPath.c_str(), mountRegistryFilePath.c_str()) == 0) {
+        dirty = false;
+    }
+}
+
+
+// IDLE MOUNT REAPER
+
+// Defined after the registry and the table, so its thread is stopped before they are destroyed
+IdleMountReaper globalMountReaper;
+
+
+IdleMountReaper::~IdleMountReaper() {
+    if (reaper.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        if (eventfd_write(wakeFd, 1) == 0) {
+            reaper.join();
+        } else {
+            reaper.detach();
+        }
+    }
+    if (wakeFd != -1) close(wakeFd);
+    if (fanotifyFd != -1) close(fanotifyFd);
+}
+
+
+// Function to track the mounts registered by earlier sessions, counted as used now
+void IdleMountReaper::seed() {
+    std::call_once(seedOnce, [this]() {
+        std::vector<std::string> mounted = globalMountRegistry.mountedPoints();
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const std::string& mountPoint : mounted) {
+            if (!mounts.count(mountPoint)) watchLocked(mountPoint);
+        }
+    });
+}
+
+
+void IdleMountReaper::configure(size_t maxMountedSetting, std::chrono::minutes idleSetting) {
+    seed();
+    std::lock_guard<std::mutex> lock(mutex);
+    bool wasTracking = tracking();
+    maxMounted = maxMountedSetting;
+    idleTime = idleSetting;
+    if (!tracking()) return;
+
+    if (!wasTracking && !reaper.joinable()) {
+        // Mounts tracked so far get their marks now, later ones in watch()
+        fanotifyFd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK, O_RDONLY | O_LARGEFILE);
+        for (const auto& [mountPoint, tracked] : mounts) markLocked(mountPoint);
+
+        wakeFd = eventfd(0, EFD_CLOEXEC);
+        if (wakeFd != -1) reaper = std::thread(&IdleMountReaper::reapLoop, this);
+    } else if (wakeFd != -1) {
+        eventfd_write(wakeFd, 1); // The thread picks up a changed idle timeout
+    }
+}
+
+
+size_t IdleMountReaper::reserve(size_t wanted, const std::unordered_set<std::string>& keep) {
+    seed();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (maxMounted == 0) return wanted;
+
+    // Mounts removed outside Iso Commander no longer take a place
+    for (auto it = mounts.begin(); it != mounts.end();) {
+        if (globalMountTable.contains(it->first)) {
+            ++it;
+            continue;
+        }
+        devices.erase(it->second.device);
+        globalMountRegistry.release(it->first);
+        it = mounts.erase(it);
+    }
+
+    if (mounts.size() + wanted > maxMounted) {
+        evictLocked(mounts.size() + wanted - maxMounted, keep, idleTime);
+    }
+    return mounts.size() >= maxMounted ? 0 : std::min(wanted, maxMounted - mounts.size());
+}
+
+
+void IdleMountReaper::watch(const std::string& mountPoint) {
+    seed();
+    std::lock_guard<std::mutex> lock(mutex);
+    watchLocked(mountPoint);
+}
+
+
+void IdleMountReaper::forget(const std::string& mountPoint) {
+    std::lock_guard<std::mutex> lock(mutex);
+    forgetLocked(mountPoint);
+}
+
+
+void IdleMountReaper::watchLocked(const std::string& mountPoint) {
+    TrackedMount& tracked = mounts[mountPoint];
+    tracked.lastUsed = Clock::now();
+    struct stat mountRoot;
+    if (stat(mountPoint.c_str(), &mountRoot) == 0) {
+        tracked.device = mountRoot.st_dev;
+        devices[mountRoot.st_dev] = mountPoint;
+    }
+    markLocked(mountPoint);
+}
+
+
+// Function to have fanotify report file and folder opens anywhere on a mount, reads of open files
+// are not reported since a mount with open files is never unmounted anyway
+void IdleMountReaper::markLocked(const std::string& mountPoint) {
+    if (fanotifyFd == -1) return;
+    fanotify_mark(fanotifyFd, FAN_MARK_ADD | FAN_MARK_MOUNT, FAN_OPEN | FAN_ONDIR, AT_FDCWD, mountPoint.c_str());
+}
+
+
+void IdleMountReaper::forgetLocked(const std::string& mountPoint) {
+    auto it = mounts.find(mountPoint);
+    if (it == mounts.end()) return;
+    auto device = devices.find(it->second.device);
+    if (device != devices.end() && device->second == mountPoint) devices.erase(device);
+    mounts.erase(it);
+}
+
+
+// Function to move the mounts opened since the last call to the end of the LRU order
+void IdleMountReaper::drainEventsLocked() {
+    if (fanotifyFd == -1) return;
+
+    alignas(struct fanotify_event_metadata) char buffer[8192];
+    const Clock::time_point now = Clock::now();
+    ssize_t length;
+    while ((length = read(fanotifyFd, buffer, sizeof(buffer))) > 0) {
+        auto* event = reinterpret_cast<struct fanotify_event_metadata*>(buffer);
+        for (; FAN_EVENT_OK(event, length); event = FAN_EVENT_NEXT(event, length)) {
+            if (event->mask & FAN_Q_OVERFLOW) {
+                // Events were lost, so every mount may have been used
+                for (auto& [mountPoint, tracked] : mounts) tracked.lastUsed = now;
+                continue;
+            }
+            if (event->fd < 0) continue;
+            struct stat opened;
+            if (fstat(event->fd, &opened) == 0) {
+                auto device = devices.find(opened.st_dev);
+                if (device != devices.end()) mounts[device->second].lastUsed = now;
+            }
+            close(event->fd);
+        }
+    }
+}
+
+
+// Function to unmount up to count mounts unused for minIdle, least recently used first
+size_t IdleMountReaper::evictLocked(size_t count, const std::unordered_set<std::string>& keep, Clock::duration minIdle) {
+    drainEventsLocked();
+    const Clock::time_point now = Clock::now();
+
+    std::vector<std::pair<Clock::time_point, std::string>> candidates;
+    for (const auto& [mountPoint, tracked] : mounts) {
+        if (now - tracked.lastUsed >= minIdle && !keep.count(mountPoint)) {
+            candidates.emplace_back(tracked.lastUsed, mountPoint);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    size_t freed = 0;
+    for (const auto& [lastUsed, mountPoint] : candidates) {
+        if (freed == count) break;
+        // Without MNT_DETACH the kernel refuses mounts with open files or working directories in them
+        if (umount2(mountPoint.c_str(), 0) != 0) {
+            if (errno == EBUSY) {
+                mounts[mountPoint].lastUsed = now;
+                continue;
+            }
+            if (errno != EINVAL) continue; // EINVAL: no longer mounted
+        }
+        forgetLocked(mountPoint);
+        globalMountTable.noteUnmounted(mountPoint);
+        globalMountRegistry.release(mountPoint);
+        rmdir(mountPoint.c_str());
+        ++freed;
+    }
+    return freed;
+}
+
+
+// Function run by the background thread: timestamps opens as fanotify reports them and, with an idle timeout,
+// unmounts the mounts past it a few times per timeout period
+void IdleMountReaper::reapLoop() {
+    Clock::time_point nextReap = Clock::now();
+    for (;;) {
+        int timeoutMs = -1;
+        size_t freed = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) return;
+            if (idleTime.count() > 0) {
+                Clock::time_point now = Clock::now();
+                if (now >= nextReap) {
+                    freed = evictLocked(SIZE_MAX, {}, idleTime);
+                    nextReap = now + std::clamp<Clock::duration>(idleTime / 4, std::chrono::seconds(5), std::chrono::minutes(1));
+                }
+                timeoutMs = static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(nextReap - now).count());
+            }
+        }
+        if (freed > 0) globalMountRegistry.save();
+
+        struct pollfd fds[2] = {{wakeFd, POLLIN, 0}, {fanotifyFd, POLLIN, 0}};
+        if (poll(fds, fanotifyFd != -1 ? 2 : 1, timeoutMs) <= 0) continue;
+        if (fds[0].revents & POLLIN) {
+            eventfd_t wake;
+            eventfd_read(wakeFd, &wake);
+        }
+        if (fds[1].revents & POLLIN) {
+            std::lock_guard<std::mutex> lock(mutex);
+            drainEventsLocked();
+        }
+    }
+}
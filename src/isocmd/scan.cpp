@@ -0,0 +1,716 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#include "../headers.h"
+#include "../scan.h"
+#include "../metaio.h"
+#include <fnmatch.h>
+#include <linux/ioprio.h>
+#include <map>
+#include <sys/resource.h>
+#include <sys/statfs.h>
+#include <sys/syscall.h>
+
+
+// Scan rules config path
+const std::string scanRulesFilePath = std::string(getenv("HOME")) + "/.config/isocmd/config/iso_commander_scan.txt";
+
+// Journal of the interactive import in progress
+const std::string importJournalFilePath = std::string(getenv("HOME")) + "/.local/share/isocmd/database/iso_commander_import_journal.txt";
+
+// statfs f_type values of virtual filesystems that never hold ISO files
+static constexpr std::array<unsigned long, 19> PSEUDO_FS_TYPES = {
+    0x9fa0,      // proc
+    0x1373,      // devtmpfs
+    0x62656572,  // sysfs
+    0x1cd1,      // devpts
+    0x27e0eb,    // cgroup
+    0x63677270,  // cgroup2
+    0x64626720,  // debugfs
+    0x74726163,  // tracefs
+    0x73636673,  // securityfs
+    0x6165676c,  // pstore
+    0xcafe4a11,  // bpf
+    0x62656570,  // configfs
+    0x65735543,  // fusectl
+    0x19800202,  // mqueue
+    0x958458f6,  // hugetlbfs
+    0x42494e4d,  // binfmt_misc
+    0xde5e81e4,  // efivarfs
+    0x6e736673,  // nsfs
+    0xf97cff8c   // selinuxfs
+};
+
+
+// Kernel layout of a getdents64 record
+struct linux_dirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+
+// Function to load scan pruning rules, one key=value per line and '#' for comments
+ScanRules loadScanRules() {
+    ScanRules rules;
+    for (const auto& [key, value] : readConfigPairs(scanRulesFilePath)) {
+        if (key == "skip_pseudo_fs") {
+            rules.skipPseudoFs = (value == "1");
+        } else if (key == "skip_iso_mounts") {
+            rules.skipIsoMounts = (value == "1");
+        } else if (key == "same_filesystem") {
+            rules.sameFilesystem = (value == "1");
+        } else if (key == "follow_symlinks") {
+            rules.followSymlinks = (value == "1");
+        } else if (key == "canonical_paths") {
+            rules.canonicalPaths = (value == "1");
+        } else if (key == "magic_probe") {
+            rules.magicProbe = (value == "1");
+        } else if (key == "io_uring_depth") {
+            try {
+                rules.ioUringDepth = static_cast<unsigned>(std::stoul(value));
+            } catch (const std::exception&) {
+                // Keep the default on malformed values
+            }
+        } else if (key == "background_nice" || key == "background_dirs_per_sec" || key == "background_mb_per_sec") {
+            try {
+                int number = std::stoi(value);
+                if (key == "background_nice") {
+                    rules.backgroundNice = std::clamp(number, 0, 19);
+                } else if (key == "background_dirs_per_sec") {
+                    rules.backgroundDirsPerSecond = static_cast<unsigned>(std::max(number, 0));
+                } else {
+                    rules.backgroundMegabytesPerSecond = static_cast<unsigned>(std::max(number, 0));
+                }
+            } catch (const std::exception&) {
+                // Keep the default on malformed values
+            }
+        } else if (key == "background_idle_io") {
+            rules.backgroundIdleIo = (value == "1");
+        } else if (key == "exclude" && !value.empty()) {
+            rules.excludeGlobs.push_back(value);
+        }
+    }
+    return rules;
+}
+
+
+// BACKGROUND THROTTLING
+
+std::atomic<int> foregroundOperations{0};
+
+
+BackgroundThrottle::BackgroundThrottle(const ScanRules& rules)
+    : dirRate(rules.backgroundDirsPerSecond),
+      byteRate(rules.backgroundMegabytesPerSecond * 1024.0 * 1024.0),
+      dirTokens(dirRate),
+      byteTokens(byteRate),
+      lastRefill(std::chrono::steady_clock::now()) {
+}
+
+
+// Function to top up both buckets for the time passed, at most one second of burst
+void BackgroundThrottle::refill() {
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - lastRefill).count();
+    lastRefill = now;
+    dirTokens = std::min(dirRate, dirTokens + elapsed * dirRate);
+    byteTokens = std::min(byteRate, byteTokens + elapsed * byteRate);
+}
+
+
+// Function to wait until the walker may read its next directory
+void BackgroundThrottle::beforeDirectory() {
+    // Interactive mounts, copies and conversions get the disks to themselves
+    while (foregroundOperations.load(std::memory_order_relaxed) > 0) {
+        std::this_thread::sleep_for(PAUSE_POLL_INTERVAL);
+    }
+
+    if (dirRate <= 0 && byteRate <= 0) return;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        refill();
+        double waitSeconds = 0;
+        if (dirRate > 0 && dirTokens < 1) {
+            waitSeconds = (1 - dirTokens) / dirRate;
+        }
+        if (byteRate > 0 && byteTokens < 0) {
+            waitSeconds = std::max(waitSeconds, -byteTokens / byteRate);
+        }
+        if (waitSeconds <= 0) break;
+
+        lock.unlock();
+        std::this_thread::sleep_for(std::chrono::duration<double>(waitSeconds));
+        lock.lock();
+    }
+    if (dirRate > 0) {
+        dirTokens -= 1;
+    }
+}
+
+
+// Function to charge a directory listing against the byte budget
+void BackgroundThrottle::addBytes(size_t bytes) {
+    if (byteRate <= 0) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    byteTokens -= static_cast<double>(bytes);
+}
+
+
+// Function to move the calling thread to the idle I/O class and a high nice level
+void lowerBackgroundPriority(const ScanRules& rules) {
+    pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+    // Linux applies nice and ioprio per thread, both are inherited by threads created afterwards
+    setpriority(PRIO_PROCESS, static_cast<id_t>(tid), rules.backgroundNice);
+    if (rules.backgroundIdleIo) {
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 0));
+    }
+}
+
+
+// IMPORT JOURNAL
+
+// Journal lines: "V <maxDepth>", "S <rule flags>", one "X <glob>" per exclude glob, one "R <root>" per root,
+// then "I <iso>" and "D <finished folder>" as the walk goes
+ImportJournal::ImportJournal(const std::vector<std::string>& roots, int maxDepth, const ScanRules& rules) : lastFlush(std::chrono::steady_clock::now()) {
+    std::vector<std::string> header;
+    header.push_back("V " + std::to_string(maxDepth));
+
+    // Fingerprint of the rules that decide which folders are walked and which paths are recorded
+    std::string flags = "S ";
+    for (bool flag : {rules.skipPseudoFs, rules.skipIsoMounts, rules.sameFilesystem, rules.followSymlinks, rules.canonicalPaths, rules.magicProbe}) {
+        flags += flag ? '1' : '0';
+    }
+    header.push_back(flags);
+    for (const auto& glob : rules.excludeGlobs) {
+        header.push_back("X " + glob);
+    }
+
+    std::set<std::string> sortedRoots(roots.begin(), roots.end());
+    for (const auto& root : sortedRoots) {
+        header.push_back("R " + root);
+    }
+
+    // Resume only an import of exactly the same roots, depth and rules, finished folders of another walk are not finished for this one
+    bool sameImport = false;
+    {
+        std::ifstream file(importJournalFilePath);
+        std::string line;
+        size_t headerIndex = 0;
+        sameImport = file.is_open();
+        while (sameImport && std::getline(file, line)) {
+            if (headerIndex < header.size()) {
+                sameImport = (line == header[headerIndex++]);
+            } else if (line.size() > 2 && line[0] == 'I' && line[1] == ' ') {
+                recoveredIso.push_back(line.substr(2));
+            } else if (line.size() > 2 && line[0] == 'D' && line[1] == ' ') {
+                completed.insert(line.substr(2));
+            }
+        }
+        sameImport = sameImport && headerIndex == header.size();
+    }
+    if (!sameImport) {
+        recoveredIso.clear();
+        completed.clear();
+    }
+
+    std::filesystem::path dirPath = std::filesystem::path(importJournalFilePath).parent_path();
+    if (!std::filesystem::exists(dirPath) && !std::filesystem::create_directories(dirPath)) {
+        return;
+    }
+
+    fd = open(importJournalFilePath.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (sameImport ? 0 : O_TRUNC), 0644);
+    if (fd != -1 && !sameImport) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& line : header) {
+            pending += line;
+            pending += '\n';
+        }
+        flushLocked();
+    }
+}
+
+
+ImportJournal::~ImportJournal() {
+    if (fd != -1) {
+        std::lock_guard<std::mutex> lock(mutex);
+        flushLocked();
+        close(fd);
+    }
+}
+
+
+// Function to journal an ISO found by the import
+void ImportJournal::recordIso(const std::string& isoPath) {
+    append('I', isoPath);
+}
+
+
+// Function to journal a folder whose whole subtree has been walked
+void ImportJournal::recordCompleted(const std::string& dir) {
+    append('D', dir);
+}
+
+
+// Function to queue one journal line, written out in batches
+void ImportJournal::append(char tag, const std::string& value) {
+    if (fd == -1) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    pending += tag;
+    pending += ' ';
+    pending += value;
+    pending += '\n';
+    if (pending.size() >= FLUSH_BYTES || std::chrono::steady_clock::now() - lastFlush >= FLUSH_INTERVAL) {
+        flushLocked();
+    }
+}
+
+
+// Function to write queued lines, the page cache keeps them even if the process dies right after
+void ImportJournal::flushLocked() {
+    size_t written = 0;
+    while (written < pending.size()) {
+        ssize_t result = write(fd, pending.data() + written, pending.size() - written);
+        if (result == -1) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        written += static_cast<size_t>(result);
+    }
+    pending.clear();
+    lastFlush = std::chrono::steady_clock::now();
+}
+
+
+// Function to drop the journal once the import is safely in the cache
+void ImportJournal::finish() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (fd != -1) {
+        pending.clear();
+        close(fd);
+        fd = -1;
+    }
+    std::remove(importJournalFilePath.c_str());
+}
+
+
+// Record a directory, returns false if it was already visited
+bool VisitedDirectories::insert(dev_t dev, ino_t ino) {
+    Shard& shard = shards[(static_cast<size_t>(ino) ^ static_cast<size_t>(dev)) % SHARD_COUNT];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.keys.emplace(dev, ino).second;
+}
+
+
+DirectoryWalker::DirectoryWalker(int maxDepth, const ScanRules& rules, FileCallback onFile, std::vector<std::string>& errors, VisitedDirectories* sharedVisited)
+    : maxDepth(maxDepth), rules(rules), onFile(std::move(onFile)), errors(errors), buffer(DENTS_BUFFER_SIZE) {
+    // A depth-limited walk must not claim directories another root would walk deeper
+    if (sharedVisited && maxDepth < 0) {
+        visited = sharedVisited;
+    } else {
+        ownVisited = std::make_unique<VisitedDirectories>();
+        visited = ownVisited.get();
+    }
+    path.reserve(PATH_MAX);
+}
+
+
+// Record a traversal error for a path
+void DirectoryWalker::addError(const std::string& errorPath, int errorNumber) {
+    errors.push_back(errorPath + " - " + strerror(errorNumber));
+}
+
+
+// Check the current path against the user exclude globs
+bool DirectoryWalker::isExcluded() const {
+    for (const auto& glob : rules.excludeGlobs) {
+        if (fnmatch(glob.c_str(), path.c_str(), 0) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Decide whether an opened child directory is pruned, statfs is only needed at filesystem boundaries
+bool DirectoryWalker::isPruned(int childFd, dev_t parentDev, dev_t& childDev) const {
+    struct stat st;
+    if (fstat(childFd, &st) == -1) return true;
+    childDev = st.st_dev;
+
+    // Bind mounts, overlapping roots and symlink cycles all land on an already visited (dev, ino)
+    if (!visited->insert(st.st_dev, st.st_ino)) return true;
+
+    if (childDev == parentDev) return false;
+    if (rules.sameFilesystem && childDev != rootDev) return true;
+
+    if (rules.skipPseudoFs) {
+        struct statfs fs;
+        if (fstatfs(childFd, &fs) == 0 &&
+            std::find(PSEUDO_FS_TYPES.begin(), PSEUDO_FS_TYPES.end(), static_cast<unsigned long>(fs.f_type)) != PSEUDO_FS_TYPES.end()) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+// Walk a root directory
+void DirectoryWalker::walk(const std::string& root) {
+    int rootFd = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (rootFd == -1) {
+        addError(root, errno);
+        return;
+    }
+
+    path = root;
+    while (path.size() > 1 && path.back() == '/') {
+        path.pop_back();
+    }
+    if (path == "/") {
+        path.clear(); // Children are appended as "/name"
+    }
+
+    struct stat st;
+    if (fstat(rootFd, &st) == -1) {
+        addError(root, errno);
+        close(rootFd);
+        return;
+    }
+    rootDev = st.st_dev;
+
+    // A root finished before an interruption is not walked again
+    const std::string rootKey = path.empty() ? "/" : path;
+    if (journal && journal->isCompleted(rootKey)) {
+        close(rootFd);
+        return;
+    }
+
+    // Overlapping roots are walked only once
+    if (visited->insert(st.st_dev, st.st_ino)) {
+        walkDirectory(rootFd, rootDev, 0);
+        if (journal) {
+            journal->recordCompleted(rootKey);
+        }
+    }
+    close(rootFd);
+}
+
+
+// Read one directory with getdents64, report files and descend into subdirectories
+void DirectoryWalker::walkDirectory(int dirFd, dev_t dirDev, int depth) {
+    // Subdirectory names are collected first so the dents buffer can be reused by the recursion
+    std::vector<std::pair<std::string, bool>> subdirs;
+    const bool descend = (maxDepth < 0 || depth < maxDepth);
+
+    // Files go to the callback, directories are queued, everything else is ignored
+    auto handleEntry = [&](const char* name, unsigned char type, bool isLink) {
+        if (type == DT_REG) {
+            std::string_view nameView(name);
+            size_t parentLength = path.size();
+            path.push_back('/');
+            path.append(nameView);
+            if (rules.excludeGlobs.empty() || !isExcluded()) {
+                onFile(nameView, path);
+            }
+            path.resize(parentLength);
+        } else if (type == DT_DIR && descend && (!isLink || rules.followSymlinks)) {
+            // isocmd's own loop mounts would re-read every ISO's contents through the loop device
+            if (rules.skipIsoMounts && path == "/mnt" && std::strncmp(name, "iso_", 4) == 0) {
+                return;
+            }
+            // /dev is a plain tmpfs in containers and /dev/shm is one everywhere, tmpfs elsewhere may hold ISOs
+            if (rules.skipPseudoFs && ((path.empty() && std::strcmp(name, "dev") == 0) || (path == "/dev" && std::strcmp(name, "shm") == 0))) {
+                return;
+            }
+            subdirs.emplace_back(name, isLink);
+        }
+    };
+
+    auto typeFromMode = [](mode_t mode) -> unsigned char {
+        if (S_ISREG(mode)) return DT_REG;
+        if (S_ISDIR(mode)) return DT_DIR;
+        return DT_UNKNOWN;
+    };
+
+    // Entries whose type needs a stat, resolved in one batch per getdents64 chunk
+    std::vector<const char*> unknownNames, linkNames;
+    std::vector<PathStat> stats;
+
+    if (throttle) {
+        throttle->beforeDirectory();
+    }
+
+    while (true) {
+        long bytesRead = syscall(SYS_getdents64, dirFd, buffer.data(), buffer.size());
+        if (bytesRead == 0) break;
+        if (bytesRead < 0) {
+            if (errno == EINTR) continue;
+            addError(path.empty() ? "/" : path, errno);
+            break;
+        }
+        if (throttle) {
+            throttle->addBytes(static_cast<size_t>(bytesRead));
+        }
+
+        unknownNames.clear();
+        linkNames.clear();
+
+        for (long offset = 0; offset < bytesRead;) {
+            auto* entry = reinterpret_cast<linux_dirent64*>(buffer.data() + offset);
+            offset += entry->d_reclen;
+
+            const char* name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+
+            // Only DT_UNKNOWN and symlinks need a stat, to learn what they point at
+            if (entry->d_type == DT_UNKNOWN) {
+                unknownNames.push_back(name);
+            } else if (entry->d_type == DT_LNK) {
+                linkNames.push_back(name);
+            } else {
+                handleEntry(name, entry->d_type, false);
+            }
+        }
+
+        // Names still point into the dents buffer, which is not refilled before these are done
+        if (!unknownNames.empty()) {
+            statNamesAt(dirFd, unknownNames, AT_SYMLINK_NOFOLLOW, stats);
+            for (size_t i = 0; i < unknownNames.size(); ++i) {
+                if (stats[i].error != 0) continue;
+                if (S_ISLNK(stats[i].mode)) {
+                    linkNames.push_back(unknownNames[i]);
+                } else {
+                    handleEntry(unknownNames[i], typeFromMode(stats[i].mode), false);
+                }
+            }
+        }
+        if (!linkNames.empty()) {
+            statNamesAt(dirFd, linkNames, 0, stats);
+            for (size_t i = 0; i < linkNames.size(); ++i) {
+                if (stats[i].error != 0) continue;
+                handleEntry(linkNames[i], typeFromMode(stats[i].mode), true);
+            }
+        }
+    }
+
+    for (const auto& [subdir, isLink] : subdirs) {
+        size_t parentLength = path.size();
+        path.push_back('/');
+        path.append(subdir);
+
+        if ((!rules.excludeGlobs.empty() && isExcluded()) || (journal && journal->isCompleted(path))) {
+            path.resize(parentLength);
+            continue;
+        }
+
+        // Symlinked directories are only opened through the link when followSymlinks is set
+        int childFd = openat(dirFd, subdir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC | (isLink ? 0 : O_NOFOLLOW));
+        if (childFd == -1) {
+            addError(path, errno);
+        } else {
+            dev_t childDev;
+            if (!isPruned(childFd, dirDev, childDev)) {
+                walkDirectory(childFd, childDev, depth + 1);
+                if (journal) {
+                    journal->recordCompleted(path);
+                }
+            }
+            close(childFd);
+        }
+
+        path.resize(parentLength);
+    }
+}
+
+
+// SCAN PROGRESS
+
+ScanProgress::~ScanProgress() {
+    stop();
+}
+
+
+// Function to start the progress render thread
+void ScanProgress::start() {
+    std::lock_guard<std::mutex> lock(renderMutex);
+    if (running) return;
+    running = true;
+    renderer = std::thread(&ScanProgress::renderLoop, this);
+}
+
+
+// Function to stop the progress render thread
+void ScanProgress::stop() {
+    {
+        std::lock_guard<std::mutex> lock(renderMutex);
+        if (!running) return;
+        running = false;
+    }
+    renderCv.notify_one();
+    renderer.join();
+    renderFrame(total());
+}
+
+
+// Function to give a worker a counter it alone updates
+ScanProgress::Slot& ScanProgress::acquireSlot() {
+    return slots[nextSlot.fetch_add(1, std::memory_order_relaxed) % SLOT_COUNT];
+}
+
+
+// Function to sum the worker counters
+size_t ScanProgress::total() const {
+    size_t sum = 0;
+    for (const auto& slot : slots) {
+        sum += slot.count.load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+
+// Function to redraw the counter at a fixed frame rate, only when it changed
+void ScanProgress::renderLoop() {
+    size_t lastRendered = 0;
+    bool firstFrame = true;
+    std::unique_lock<std::mutex> lock(renderMutex);
+    while (running) {
+        lock.unlock();
+        size_t count = total();
+        if (firstFrame || count != lastRendered) {
+            renderFrame(count);
+            lastRendered = count;
+            firstFrame = false;
+        }
+        lock.lock();
+        renderCv.wait_for(lock, FRAME_INTERVAL, [this] { return !running; });
+    }
+}
+
+
+// Function to print one progress frame
+void ScanProgress::renderFrame(size_t count) {
+    std::cout << "\r\033[0;1mTotal files processed: " << count << std::flush;
+}
+
+
+// DISCOVERY
+
+// Roots walked by a discovery pass, with the modes that have not consumed them yet
+static std::mutex discoveredRootsMutex;
+static std::map<std::string, std::set<std::string>> discoveredRoots;
+
+
+// Strip trailing slashes so "/a/b/" and "/a/b" share one key
+static std::string normalizeRoot(const std::string& root) {
+    std::string key = root;
+    while (key.size() > 1 && key.back() == '/') {
+        key.pop_back();
+    }
+    return key;
+}
+
+
+// Function to classify a raw entry name by extension
+ImageKind classifyImageName(std::string_view name) {
+    if (hasSuffixIgnoreCase(name, ".iso")) return ImageKind::Iso;
+    if (hasSuffixIgnoreCase(name, ".bin") || hasSuffixIgnoreCase(name, ".img")) return ImageKind::BinImg;
+    if (hasSuffixIgnoreCase(name, ".mdf")) return ImageKind::Mdf;
+    if (hasSuffixIgnoreCase(name, ".nrg")) return ImageKind::Nrg;
+    return ImageKind::None;
+}
+
+
+// Function to confirm a candidate by its on-disk signature
+bool matchesImageMagic(const std::string& path, ImageKind kind) {
+    static const char SYNC_PATTERN[12] = {0x00, '\xFF', '\xFF', '\xFF', '\xFF', '\xFF', '\xFF', '\xFF', '\xFF', '\xFF', '\xFF', 0x00};
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return false;
+
+    auto readAt = [fd](off_t offset, char* out, size_t length) {
+        return pread(fd, out, length, offset) == static_cast<ssize_t>(length);
+    };
+
+    char head[12] = {};
+    char volumeId[5] = {};
+    bool hasSync = readAt(0, head, sizeof(head)) && std::memcmp(head, SYNC_PATTERN, sizeof(head)) == 0;
+    bool hasVolumeDescriptor = readAt(32769, volumeId, sizeof(volumeId)) &&
+        (std::memcmp(volumeId, "CD001", 5) == 0 || std::memcmp(volumeId, "BEA01", 5) == 0 ||
+         std::memcmp(volumeId, "NSR02", 5) == 0 || std::memcmp(volumeId, "NSR03", 5) == 0);
+
+    bool matches = false;
+    switch (kind) {
+        case ImageKind::Iso:
+            matches = hasVolumeDescriptor;
+            break;
+        case ImageKind::BinImg:
+            // Raw sectors start with a sync pattern, cooked images carry an ISO9660/UDF descriptor
+            matches = hasSync || hasVolumeDescriptor;
+            break;
+        case ImageKind::Mdf:
+            // Same rule as convertMdfToIso: a plain ISO renamed to .mdf is not an MDF
+            matches = std::memcmp(volumeId, "CD001", 5) != 0;
+            break;
+        case ImageKind::Nrg: {
+            struct stat st;
+            char footer[12] = {};
+            if (fstat(fd, &st) == 0 && st.st_size >= 12 && readAt(st.st_size - 12, footer, sizeof(footer))) {
+                matches = std::memcmp(footer, "NER5", 4) == 0 || std::memcmp(footer + 4, "NERO", 4) == 0;
+            }
+            break;
+        }
+        case ImageKind::None:
+            break;
+    }
+
+    close(fd);
+    return matches;
+}
+
+
+// Function to persist one discovery pass into every catalog
+void publishDiscoveredImages(DiscoveredImages& discovered, const std::vector<std::string>& roots, const std::string& scannedMode) {
+    std::lock_guard<std::mutex> lock(discovered.mutex);
+
+    // The scanning mode stores its own results, only the other catalogs are written here
+    if (scannedMode != "iso" && !discovered.iso.empty()) {
+        saveCache(discovered.iso, maxCacheSize);
+    }
+    if (scannedMode != "bin" && !discovered.binImg.empty()) {
+        saveImageCatalog("bin", discovered.binImg);
+    }
+    if (scannedMode != "mdf" && !discovered.mdf.empty()) {
+        saveImageCatalog("mdf", discovered.mdf);
+    }
+    if (scannedMode != "nrg" && !discovered.nrg.empty()) {
+        saveImageCatalog("nrg", discovered.nrg);
+    }
+
+    std::lock_guard<std::mutex> rootsLock(discoveredRootsMutex);
+    for (const auto& root : roots) {
+        auto& pendingModes = discoveredRoots[normalizeRoot(root)];
+        for (const char* mode : {"iso", "bin", "mdf", "nrg"}) {
+            if (scannedMode != mode) {
+                pendingModes.insert(mode);
+            }
+        }
+    }
+}
+
+
+// Function to check and consume a root that another mode's pass already walked
+bool consumeDiscoveredRoot(const std::string& root, const std::string& mode) {
+    std::lock_guard<std::mutex> lock(discoveredRootsMutex);
+    auto it = discoveredRoots.find(normalizeRoot(root));
+    if (it == discoveredRoots.end()) {
+        return false;
+    }
+    // Consumed once, so repeating a search in the same mode walks the disk again
+    return it->second.erase(mode) > 0;
+}
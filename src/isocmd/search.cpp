@@ -0,0 +1,1626 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#include "../headers.h"
+#include "../search.h"
+#include <bitset>
+#include <deque>
+#include <map>
+#include <numeric>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+
+// SUBSTRING KERNELS
+
+// All kernels test the first and last needle bytes at every position of a block at once,
+// only positions where both match get a memcmp of the bytes in between.
+// Vector kernels load up to SUBSTRING_PADDING - 1 bytes past the text, the index provides them.
+
+namespace {
+
+// Function to confirm a candidate whose first and last bytes already matched
+inline bool middleMatches(const char* candidate, const char* needle, size_t needleLen) {
+    return needleLen <= 2 || std::memcmp(candidate + 1, needle + 1, needleLen - 2) == 0;
+}
+
+
+// Function to search without vector loads, memchr finds the candidates
+bool scalarContains(const char* text, size_t textLen, const char* needle, size_t needleLen) {
+    if (needleLen > textLen) return false;
+    const char* p = text;
+    const char* last = text + (textLen - needleLen);
+    while (p <= last) {
+        p = static_cast<const char*>(std::memchr(p, needle[0], static_cast<size_t>(last - p) + 1));
+        if (!p) return false;
+        if (p[needleLen - 1] == needle[needleLen - 1] && middleMatches(p, needle, needleLen)) return true;
+        ++p;
+    }
+    return false;
+}
+
+
+#if defined(__x86_64__)
+
+// Function to keep only the candidate bits of positions where the whole needle still fits
+inline uint64_t clampCandidates(uint64_t mask, size_t position, size_t lastStart) {
+    size_t remaining = lastStart - position; // Candidates beyond bit "remaining" would overrun the text
+    return remaining < 63 ? mask & ((uint64_t(2) << remaining) - 1) : mask;
+}
+
+
+// Function to search 16 positions per step, SSE2 is part of every x86-64 CPU
+bool sse2Contains(const char* text, size_t textLen, const char* needle, size_t needleLen) {
+    if (needleLen > textLen) return false;
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needleLen - 1]);
+    const size_t lastStart = textLen - needleLen;
+
+    for (size_t i = 0; i <= lastStart; i += 16) {
+        __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i + needleLen - 1));
+        uint64_t mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, blockFirst), _mm_cmpeq_epi8(last, blockLast))));
+        mask = clampCandidates(mask, i, lastStart);
+        while (mask) {
+            if (middleMatches(text + i + __builtin_ctzll(mask), needle, needleLen)) return true;
+            mask &= mask - 1;
+        }
+    }
+    return false;
+}
+
+
+// Function to search 32 positions per step
+__attribute__((target("avx2")))
+bool avx2Contains(const char* text, size_t textLen, const char* needle, size_t needleLen) {
+    if (needleLen > textLen) return false;
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needleLen - 1]);
+    const size_t lastStart = textLen - needleLen;
+
+    for (size_t i = 0; i <= lastStart; i += 32) {
+        __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i));
+        __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i + needleLen - 1));
+        uint64_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst), _mm256_cmpeq_epi8(last, blockLast))));
+        mask = clampCandidates(mask, i, lastStart);
+        while (mask) {
+            if (middleMatches(text + i + __builtin_ctzll(mask), needle, needleLen)) return true;
+            mask &= mask - 1;
+        }
+    }
+    return false;
+}
+
+
+// Function to search 64 positions per step, a typical path fits in one or two steps
+__attribute__((target("avx512f,avx512bw")))
+bool avx512Contains(const char* text, size_t textLen, const char* needle, size_t needleLen) {
+    if (needleLen > textLen) return false;
+    const __m512i first = _mm512_set1_epi8(needle[0]);
+    const __m512i last = _mm512_set1_epi8(needle[needleLen - 1]);
+    const size_t lastStart = textLen - needleLen;
+
+    for (size_t i = 0; i <= lastStart; i += 64) {
+        __m512i blockFirst = _mm512_loadu_si512(text + i);
+        __m512i blockLast = _mm512_loadu_si512(text + i + needleLen - 1);
+        uint64_t mask = _mm512_cmpeq_epi8_mask(first, blockFirst) & _mm512_cmpeq_epi8_mask(last, blockLast);
+        mask = clampCandidates(mask, i, lastStart);
+        while (mask) {
+            if (middleMatches(text + i + __builtin_ctzll(mask), needle, needleLen)) return true;
+            mask &= mask - 1;
+        }
+    }
+    return false;
+}
+
+#endif // __x86_64__
+
+
+// Function to map a kernel to its implementation
+CompiledToken::ContainsFn kernelFunction(SubstringKernel kernel) {
+    switch (kernel) {
+#if defined(__x86_64__)
+        case SubstringKernel::Sse2:   return sse2Contains;
+        case SubstringKernel::Avx2:   return avx2Contains;
+        case SubstringKernel::Avx512: return avx512Contains;
+#endif
+        default:                      return scalarContains;
+    }
+}
+
+} // namespace
+
+
+// Function to check whether the running CPU can execute a kernel
+bool substringKernelSupported(SubstringKernel kernel) {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    switch (kernel) {
+        case SubstringKernel::Scalar: return true;
+        case SubstringKernel::Sse2:   return true;
+        case SubstringKernel::Avx2:   return __builtin_cpu_supports("avx2");
+        case SubstringKernel::Avx512: return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+    }
+    return false;
+#else
+    return kernel == SubstringKernel::Scalar;
+#endif
+}
+
+
+// Function to pick the widest kernel the CPU supports, decided once per process
+SubstringKernel bestSubstringKernel() {
+    static const SubstringKernel best = [] {
+        for (SubstringKernel kernel : {SubstringKernel::Avx512, SubstringKernel::Avx2, SubstringKernel::Sse2}) {
+            if (substringKernelSupported(kernel)) return kernel;
+        }
+        return SubstringKernel::Scalar;
+    }();
+    return best;
+}
+
+
+// Function to get the display name of a kernel
+const char* substringKernelName(SubstringKernel kernel) {
+    switch (kernel) {
+        case SubstringKernel::Scalar: return "scalar";
+        case SubstringKernel::Sse2:   return "sse2";
+        case SubstringKernel::Avx2:   return "avx2";
+        case SubstringKernel::Avx512: return "avx512bw";
+    }
+    return "unknown";
+}
+
+
+// Single bytes stay on memchr, which already scans as wide as the CPU allows
+CompiledToken::CompiledToken(std::string token, SubstringKernel kernel) : needle(std::move(token)), contains(needle.size() == 1 ? scalarContains : kernelFunction(kernel)) {
+    for (char& c : needle) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+}
+
+
+// FUZZY MATCHING
+
+namespace {
+
+// Scores follow fzf: a matched byte is worth 16, bonuses reward where it sits, gaps cost a little per byte
+constexpr int SCORE_MATCH = 16;
+constexpr int SCORE_GAP_START = -3;
+constexpr int SCORE_GAP_EXTENSION = -1;
+constexpr int BONUS_BOUNDARY = SCORE_MATCH / 2;             // First byte of a word, after '-', '_', '.' or ' '
+constexpr int BONUS_BOUNDARY_DELIMITER = BONUS_BOUNDARY + 1; // First byte of a path component
+constexpr int BONUS_CONSECUTIVE = -(SCORE_GAP_START + SCORE_GAP_EXTENSION);
+constexpr int BONUS_FIRST_CHAR_MULTIPLIER = 2;
+constexpr int BONUS_FILENAME = 4;                            // Per byte matched in the last path component
+
+enum class CharClass { Delimiter, NonWord, Word };
+
+inline CharClass charClassOf(unsigned char c) {
+    if (c == '/') return CharClass::Delimiter;
+    if (std::isalnum(c) || c >= 0x80) return CharClass::Word;
+    return CharClass::NonWord;
+}
+
+
+inline int bonusFor(CharClass previous, CharClass current) {
+    if (current != CharClass::Word) return BONUS_BOUNDARY;
+    if (previous == CharClass::Delimiter) return BONUS_BOUNDARY_DELIMITER;
+    if (previous == CharClass::NonWord) return BONUS_BOUNDARY;
+    return 0;
+}
+
+
+// Function to score the shortest window that ends at the first complete match found from offset from
+bool scoreWindow(std::string_view text, std::string_view pattern, size_t from, size_t nameStart, int& score) {
+    // Forward pass, memchr jumps to each next pattern byte
+    const char* cursor = text.data() + from;
+    const char* textEnd = text.data() + text.size();
+    for (char c : pattern) {
+        cursor = static_cast<const char*>(std::memchr(cursor, c, static_cast<size_t>(textEnd - cursor)));
+        if (!cursor) return false;
+        ++cursor;
+    }
+    const size_t end = static_cast<size_t>(cursor - text.data()) - 1;
+
+    // Backward pass from the end finds the latest start, which tightens the window
+    size_t start = end;
+    size_t remaining = pattern.size();
+    for (size_t i = end + 1; i-- > from;) {
+        if (text[i] == pattern[remaining - 1] && --remaining == 0) {
+            start = i;
+            break;
+        }
+    }
+
+    int total = 0;
+    int consecutive = 0;
+    int firstBonus = 0;
+    bool inGap = false;
+    size_t next = 0;
+    CharClass previous = start > 0 ? charClassOf(text[start - 1]) : CharClass::Delimiter;
+    for (size_t i = start; i <= end; ++i) {
+        CharClass current = charClassOf(text[i]);
+        if (next < pattern.size() && text[i] == pattern[next]) {
+            int bonus = bonusFor(previous, current);
+            if (consecutive == 0) {
+                firstBonus = bonus;
+            } else {
+                // A run keeps the bonus of the boundary it started at
+                if (bonus >= BONUS_BOUNDARY && bonus > firstBonus) firstBonus = bonus;
+                bonus = std::max({bonus, firstBonus, BONUS_CONSECUTIVE});
+            }
+            total += SCORE_MATCH + (next == 0 ? bonus * BONUS_FIRST_CHAR_MULTIPLIER : bonus);
+            if (i >= nameStart) total += BONUS_FILENAME;
+            inGap = false;
+            ++consecutive;
+            ++next;
+        } else {
+            total += inGap ? SCORE_GAP_EXTENSION : SCORE_GAP_START;
+            inGap = true;
+            consecutive = 0;
+            firstBonus = 0;
+        }
+        previous = current;
+    }
+    score = total;
+    return true;
+}
+
+} // namespace
+
+
+// Function to score a row, the window inside the file name competes with the first window of the whole path
+bool fuzzyMatch(std::string_view text, std::string_view pattern, int& score) {
+    if (pattern.empty()) {
+        score = 0;
+        return true;
+    }
+    size_t slash = text.rfind('/');
+    size_t nameStart = slash == std::string_view::npos ? 0 : slash + 1;
+    if (!scoreWindow(text, pattern, 0, nameStart, score)) {
+        return false;
+    }
+    int nameScore = 0;
+    if (nameStart > 0 && scoreWindow(text, pattern, nameStart, nameStart, nameScore)) {
+        score = std::max(score, nameScore);
+    }
+    return true;
+}
+
+
+// PATTERN DFA
+
+namespace {
+
+constexpr size_t SYMBOLS = 256;
+using SymbolSet = std::bitset<SYMBOLS>;
+
+// Limits that keep a hostile pattern from taking long or much memory to compile
+constexpr int MAX_REPEAT = 1000;
+constexpr size_t MAX_NFA_NODES = 20000;
+constexpr int MAX_NESTING = 200;
+
+SymbolSet anyByte() {
+    return SymbolSet().set();
+}
+
+// Function to let an uppercase letter of a set also match the lowercase one the rows hold
+SymbolSet foldCase(SymbolSet symbols) {
+    for (size_t c = 'A'; c <= 'Z'; ++c) {
+        if (symbols[c]) symbols.set(c + ('a' - 'A'));
+    }
+    return symbols;
+}
+
+SymbolSet singleSymbol(size_t symbol) {
+    SymbolSet symbols;
+    symbols.set(symbol);
+    return symbols;
+}
+
+SymbolSet byteRange(unsigned char first, unsigned char last) {
+    SymbolSet symbols;
+    for (size_t c = first; c <= last; ++c) symbols.set(c);
+    return symbols;
+}
+
+} // namespace
+
+
+// Syntax tree both pattern forms are parsed into
+struct PatternDfa::PatternNode {
+    enum class Kind { Empty, Symbols, Concat, Alternate, Repeat, AtBegin, AtEnd };
+    Kind kind = Kind::Empty;
+    SymbolSet symbols;                  // Symbols: one input symbol out of this set
+    std::vector<PatternNode> children;  // Concat and Alternate parts, the repeated node of Repeat
+    int min = 0;                        // Repeat bounds, max is -1 when unbounded
+    int max = -1;
+
+    static PatternNode set(const SymbolSet& symbols) {
+        PatternNode node;
+        node.kind = Kind::Symbols;
+        node.symbols = symbols;
+        return node;
+    }
+
+    static PatternNode of(Kind kind) {
+        PatternNode node;
+        node.kind = kind;
+        return node;
+    }
+
+    static PatternNode repeat(PatternNode child, int min, int max) {
+        PatternNode node;
+        node.kind = Kind::Repeat;
+        node.children.push_back(std::move(child));
+        node.min = min;
+        node.max = max;
+        return node;
+    }
+};
+
+
+namespace {
+
+using PatternNode = PatternDfa::PatternNode;
+
+// Recursive descent parser of the regular expression subset the filter supports:
+// literals, ., [...] sets, \d \w \s and their negations, groups, |, * + ? {n} {n,} {n,m}, ^ and $
+class RegexParser {
+public:
+    RegexParser(std::string_view pattern, std::string& error) : pattern(pattern), error(error) {}
+
+    bool parse(PatternNode& root) {
+        if (!parseAlternate(root, 0)) return false;
+        if (position != pattern.size()) return fail("unmatched ')'");
+        return true;
+    }
+
+private:
+    bool fail(const std::string& message) {
+        error = message + " at position " + std::to_string(position + 1);
+        return false;
+    }
+
+    bool atEnd() const { return position >= pattern.size(); }
+    char peek() const { return pattern[position]; }
+
+    bool parseAlternate(PatternNode& out, int depth) {
+        if (depth > MAX_NESTING) return fail("groups nested too deeply");
+        PatternNode first;
+        if (!parseConcat(first, depth)) return false;
+        if (atEnd() || peek() != '|') {
+            out = std::move(first);
+            return true;
+        }
+        out = PatternNode();
+        out.kind = PatternNode::Kind::Alternate;
+        out.children.push_back(std::move(first));
+        while (!atEnd() && peek() == '|') {
+            ++position;
+            PatternNode next;
+            if (!parseConcat(next, depth)) return false;
+            out.children.push_back(std::move(next));
+        }
+        return true;
+    }
+
+    bool parseConcat(PatternNode& out, int depth) {
+        out = PatternNode();
+        out.kind = PatternNode::Kind::Concat;
+        while (!atEnd() && peek() != '|' && peek() != ')') {
+            PatternNode item;
+            if (!parseRepeat(item, depth)) return false;
+            out.children.push_back(std::move(item));
+        }
+        return true;
+    }
+
+    bool parseRepeat(PatternNode& out, int depth) {
+        if (!parseAtom(out, depth)) return false;
+        while (!atEnd()) {
+            int min = 0, max = -1;
+            char c = peek();
+            if (c == '*') {
+                ++position;
+            } else if (c == '+') {
+                ++position;
+                min = 1;
+            } else if (c == '?') {
+                ++position;
+                max = 1;
+            } else if (c != '{' || !parseBounds(min, max)) {
+                break;
+            }
+            if (!atEnd() && peek() == '?') ++position; // Lazy and greedy match the same rows
+            out = PatternNode::repeat(std::move(out), min, max);
+        }
+        return true;
+    }
+
+    // Function to read {n}, {n,} or {n,m}, anything else leaves '{' to be a literal
+    bool parseBounds(int& min, int& max) {
+        size_t end = pattern.find('}', position);
+        if (end == std::string_view::npos) return false;
+        std::string_view inside = pattern.substr(position + 1, end - position - 1);
+        size_t comma = inside.find(',');
+        auto number = [](std::string_view digits, int& value) {
+            if (digits.empty() || digits.size() > 4) return false;
+            value = 0;
+            for (char d : digits) {
+                if (d < '0' || d > '9') return false;
+                value = value * 10 + (d - '0');
+            }
+            return true;
+        };
+        if (comma == std::string_view::npos) {
+            if (!number(inside, min)) return false;
+            max = min;
+        } else {
+            if (!number(inside.substr(0, comma), min)) return false;
+            std::string_view upper = inside.substr(comma + 1);
+            if (upper.empty()) max = -1;
+            else if (!number(upper, max) || max < min) return false;
+        }
+        if (min > MAX_REPEAT || max > MAX_REPEAT) return false;
+        position = end + 1;
+        return true;
+    }
+
+    bool parseAtom(PatternNode& out, int depth) {
+        char c = peek();
+        ++position;
+        switch (c) {
+            case '(': {
+                if (pattern.substr(position, 2) == "?:") position += 2;
+                if (!parseAlternate(out, depth + 1)) return false;
+                if (atEnd() || peek() != ')') return fail("missing ')'");
+                ++position;
+                return true;
+            }
+            case '[': {
+                SymbolSet symbols;
+                if (!parseSet(symbols)) return false;
+                out = PatternNode::set(symbols);
+                return true;
+            }
+            case '.':
+                out = PatternNode::set(anyByte());
+                return true;
+            case '^':
+                out = PatternNode::of(PatternNode::Kind::AtBegin);
+                return true;
+            case '$':
+                out = PatternNode::of(PatternNode::Kind::AtEnd);
+                return true;
+            case '*': case '+': case '?':
+                --position;
+                return fail("nothing to repeat");
+            case '\\': {
+                SymbolSet symbols;
+                if (!parseEscape(symbols)) return false;
+                out = PatternNode::set(symbols);
+                return true;
+            }
+            default:
+                out = PatternNode::set(foldCase(singleSymbol(static_cast<unsigned char>(c))));
+                return true;
+        }
+    }
+
+    // Function to read the symbol after a backslash, classes and escaped punctuation
+    bool parseEscape(SymbolSet& symbols) {
+        if (atEnd()) return fail("trailing backslash");
+        char c = peek();
+        ++position;
+        SymbolSet digits = byteRange('0', '9');
+        SymbolSet word = digits | byteRange('a', 'z') | byteRange('A', 'Z') | singleSymbol('_');
+        SymbolSet space = singleSymbol(' ') | singleSymbol('\t') | singleSymbol('\n') | singleSymbol('\r') | singleSymbol('\f') | singleSymbol('\v');
+        switch (c) {
+            case 'd': symbols = digits; return true;
+            case 'D': symbols = anyByte() & ~digits; return true;
+            case 'w': symbols = word; return true;
+            case 'W': symbols = anyByte() & ~word; return true;
+            case 's': symbols = space; return true;
+            case 'S': symbols = anyByte() & ~space; return true;
+            case 't': symbols = singleSymbol('\t'); return true;
+            case 'n': symbols = singleSymbol('\n'); return true;
+            default:
+                if (std::isalnum(static_cast<unsigned char>(c))) {
+                    --position;
+                    return fail(std::string("unsupported escape \\") + c);
+                }
+                symbols = singleSymbol(static_cast<unsigned char>(c));
+                return true;
+        }
+    }
+
+    // Function to read a [...] set after its '[', a leading ^ negates it
+    bool parseSet(SymbolSet& symbols) {
+        bool negated = !atEnd() && peek() == '^';
+        if (negated) ++position;
+        bool first = true;
+        while (true) {
+            if (atEnd()) return fail("missing ']'");
+            char c = peek();
+            if (c == ']' && !first) {
+                ++position;
+                break;
+            }
+            first = false;
+            ++position;
+
+            SymbolSet item;
+            if (c == '\\') {
+                if (!parseEscape(item)) return false;
+                symbols |= item;
+                continue;
+            }
+            if (position + 1 < pattern.size() && peek() == '-' && pattern[position + 1] != ']') {
+                char last = pattern[position + 1];
+                if (static_cast<unsigned char>(last) < static_cast<unsigned char>(c)) return fail("reversed range");
+                position += 2;
+                symbols |= byteRange(static_cast<unsigned char>(c), static_cast<unsigned char>(last));
+                continue;
+            }
+            symbols.set(static_cast<unsigned char>(c));
+        }
+        symbols = foldCase(symbols);
+        if (negated) symbols = anyByte() & ~symbols;
+        return true;
+    }
+
+    std::string_view pattern;
+    std::string& error;
+    size_t position = 0;
+};
+
+
+// Function to parse a glob: * any run of bytes, ? one byte, [...] or [!...] one byte of a set, \ escapes
+bool parseGlob(std::string_view pattern, PatternNode& root, std::string& error) {
+    root = PatternNode();
+    root.kind = PatternNode::Kind::Concat;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        char c = pattern[i];
+        if (c == '*') {
+            if (i > 0 && pattern[i - 1] == '*') continue; // ** is the same as *
+            root.children.push_back(PatternNode::repeat(PatternNode::set(anyByte()), 0, -1));
+        } else if (c == '?') {
+            root.children.push_back(PatternNode::set(anyByte()));
+        } else if (c == '[') {
+            size_t j = i + 1;
+            bool negated = j < pattern.size() && (pattern[j] == '!' || pattern[j] == '^');
+            if (negated) ++j;
+            SymbolSet symbols;
+            bool first = true;
+            for (; j < pattern.size() && (pattern[j] != ']' || first); ++j, first = false) {
+                if (j + 2 < pattern.size() && pattern[j + 1] == '-' && pattern[j + 2] != ']') {
+                    if (static_cast<unsigned char>(pattern[j + 2]) < static_cast<unsigned char>(pattern[j])) {
+                        error = "reversed range at position " + std::to_string(j + 1);
+                        return false;
+                    }
+                    symbols |= byteRange(static_cast<unsigned char>(pattern[j]), static_cast<unsigned char>(pattern[j + 2]));
+                    j += 2;
+                } else {
+                    symbols.set(static_cast<unsigned char>(pattern[j]));
+                }
+            }
+            if (j >= pattern.size()) {
+                error = "missing ']' at position " + std::to_string(i + 1);
+                return false;
+            }
+            symbols = foldCase(symbols);
+            root.children.push_back(PatternNode::set(negated ? anyByte() & ~symbols : symbols));
+            i = j;
+        } else {
+            if (c == '\\' && i + 1 < pattern.size()) c = pattern[++i];
+            root.children.push_back(PatternNode::set(foldCase(singleSymbol(static_cast<unsigned char>(c)))));
+        }
+    }
+    return true;
+}
+
+
+constexpr uint32_t MATCH_NODE = 0;
+constexpr uint32_t NO_NODE = UINT32_MAX;
+
+// Thompson NFA: symbol nodes consume one byte, split and assertion nodes move on without consuming
+struct NfaNode {
+    enum class Kind : uint8_t { Split, Symbols, AtBegin, AtEnd };
+    Kind kind = Kind::Split;
+    int set = -1;               // Index of the symbol set of a symbols node
+    uint32_t out = MATCH_NODE;
+    uint32_t out2 = NO_NODE;    // Second branch of a split
+};
+
+class NfaBuilder {
+public:
+    explicit NfaBuilder(std::string& error) : error(error) {
+        nodes.push_back(NfaNode()); // The match node
+    }
+
+    // Function to add the nodes of a tree that continue with next, returns the entry node
+    bool compile(const PatternNode& node, uint32_t next, uint32_t& entry) {
+        if (nodes.size() > MAX_NFA_NODES) {
+            error = "pattern too large";
+            return false;
+        }
+        switch (node.kind) {
+            case PatternNode::Kind::Empty:
+                entry = next;
+                return true;
+            case PatternNode::Kind::Symbols:
+                entry = add(NfaNode{NfaNode::Kind::Symbols, setIndex(node.symbols), next, NO_NODE});
+                return true;
+            case PatternNode::Kind::AtBegin:
+                entry = add(NfaNode{NfaNode::Kind::AtBegin, -1, next, NO_NODE});
+                return true;
+            case PatternNode::Kind::AtEnd:
+                entry = add(NfaNode{NfaNode::Kind::AtEnd, -1, next, NO_NODE});
+                return true;
+            case PatternNode::Kind::Concat:
+                for (auto child = node.children.rbegin(); child != node.children.rend(); ++child) {
+                    if (!compile(*child, next, next)) return false;
+                }
+                entry = next;
+                return true;
+            case PatternNode::Kind::Alternate: {
+                if (!compile(node.children.back(), next, entry)) return false;
+                for (size_t i = node.children.size() - 1; i-- > 0;) {
+                    uint32_t branch;
+                    if (!compile(node.children[i], next, branch)) return false;
+                    entry = add(NfaNode{NfaNode::Kind::Split, -1, branch, entry});
+                }
+                return true;
+            }
+            case PatternNode::Kind::Repeat: {
+                const PatternNode& child = node.children.front();
+                uint32_t tail = next;
+                if (node.max == -1) {
+                    // Loop: the split either runs the child once more or leaves
+                    uint32_t loop = add(NfaNode{NfaNode::Kind::Split, -1, MATCH_NODE, next});
+                    uint32_t body;
+                    if (!compile(child, loop, body)) return false;
+                    nodes[loop].out = body;
+                    tail = loop;
+                } else {
+                    // Optional copies, each one may leave early
+                    for (int i = node.min; i < node.max; ++i) {
+                        uint32_t body;
+                        if (!compile(child, tail, body)) return false;
+                        tail = add(NfaNode{NfaNode::Kind::Split, -1, body, next});
+                    }
+                }
+                for (int i = 0; i < node.min; ++i) {
+                    if (!compile(child, tail, tail)) return false;
+                }
+                entry = tail;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<NfaNode> nodes;
+    std::vector<SymbolSet> sets;
+
+private:
+    uint32_t add(const NfaNode& node) {
+        nodes.push_back(node);
+        return static_cast<uint32_t>(nodes.size() - 1);
+    }
+
+    int setIndex(const SymbolSet& symbols) {
+        auto [it, inserted] = setIds.emplace(symbols, static_cast<int>(sets.size()));
+        if (inserted) sets.push_back(symbols);
+        return it->second;
+    }
+
+    std::unordered_map<SymbolSet, int> setIds;
+    std::string& error;
+};
+
+
+// Function to collect the nodes reachable from the stacked ones without consuming a byte, sorted.
+// Assertions are passed only where they hold, an unresolved end assertion stays in the set.
+void closure(const std::vector<NfaNode>& nodes, std::vector<uint32_t>& stack, std::vector<uint32_t>& mark, uint32_t stamp, bool atBegin, bool atEnd, std::vector<uint32_t>& out) {
+    out.clear();
+    while (!stack.empty()) {
+        uint32_t node = stack.back();
+        stack.pop_back();
+        if (mark[node] == stamp) continue;
+        mark[node] = stamp;
+        const NfaNode& current = nodes[node];
+        if (node == MATCH_NODE || current.kind == NfaNode::Kind::Symbols || (current.kind == NfaNode::Kind::AtEnd && !atEnd)) {
+            out.push_back(node);
+            continue;
+        }
+        if (current.kind == NfaNode::Kind::AtBegin && !atBegin) continue;
+        stack.push_back(current.out);
+        if (current.out2 != NO_NODE) stack.push_back(current.out2);
+    }
+    std::sort(out.begin(), out.end());
+}
+
+} // namespace
+
+
+// Function to compile a glob, it has to match the row from its first to its last byte
+bool PatternDfa::compileGlob(std::string_view pattern, std::string& error) {
+    PatternNode root;
+    if (!parseGlob(pattern, root, error)) return false;
+    root.children.push_back(PatternNode::of(PatternNode::Kind::AtEnd));
+    return build(root, error);
+}
+
+
+// Function to compile a regular expression, a leading run of any byte makes it match anywhere in the row
+bool PatternDfa::compileRegex(std::string_view pattern, std::string& error) {
+    PatternNode regex;
+    RegexParser parser(pattern, error);
+    if (!parser.parse(regex)) return false;
+
+    PatternNode root = PatternNode::of(PatternNode::Kind::Concat);
+    root.children.push_back(PatternNode::repeat(PatternNode::set(anyByte()), 0, -1));
+    root.children.push_back(std::move(regex));
+    return build(root, error);
+}
+
+
+// Function to turn a pattern into an NFA and the NFA into a DFA by subset construction.
+// Bytes are first grouped into classes that every set treats alike, so the table stays narrow.
+bool PatternDfa::build(const PatternNode& root, std::string& error) {
+    transitions.clear();
+    accepting.clear();
+    acceptingAtEnd.clear();
+
+    NfaBuilder nfa(error);
+    uint32_t entry;
+    if (!nfa.compile(root, MATCH_NODE, entry)) return false;
+
+    // Split the bytes into classes by the sets that contain them
+    std::array<uint16_t, SYMBOLS> classOf{};
+    classCount = 1;
+    for (const SymbolSet& symbols : nfa.sets) {
+        std::map<std::pair<uint16_t, bool>, uint16_t> renumber;
+        for (size_t symbol = 0; symbol < SYMBOLS; ++symbol) {
+            auto key = std::make_pair(classOf[symbol], static_cast<bool>(symbols[symbol]));
+            auto [it, inserted] = renumber.emplace(key, static_cast<uint16_t>(renumber.size()));
+            classOf[symbol] = it->second;
+        }
+        classCount = renumber.size();
+    }
+    std::copy(classOf.begin(), classOf.end(), symbolClass.begin());
+    std::vector<size_t> representative(classCount);
+    for (size_t symbol = SYMBOLS; symbol-- > 0;) {
+        representative[classOf[symbol]] = symbol;
+    }
+
+    std::vector<uint32_t> stack, mark(nfa.nodes.size(), 0), set, endSet;
+    uint32_t stamp = 0;
+    auto containsMatch = [](const std::vector<uint32_t>& nodes) { return !nodes.empty() && nodes.front() == MATCH_NODE; };
+
+    // State 0 is the empty NFA set, every other state is discovered from the start state
+    std::map<std::vector<uint32_t>, uint32_t> stateIds;
+    std::vector<std::vector<uint32_t>> stateSets;
+    auto intern = [&](const std::vector<uint32_t>& nodes) -> uint32_t {
+        auto it = stateIds.find(nodes);
+        if (it != stateIds.end()) return it->second;
+        uint32_t id = static_cast<uint32_t>(stateSets.size());
+        stateIds.emplace(nodes, id);
+        stateSets.push_back(nodes);
+        accepting.push_back(containsMatch(nodes));
+
+        // Row ends here: pass the end assertions left in the set
+        for (uint32_t node : nodes) {
+            if (nfa.nodes[node].kind == NfaNode::Kind::AtEnd) stack.push_back(nfa.nodes[node].out);
+        }
+        closure(nfa.nodes, stack, mark, ++stamp, false, true, endSet);
+        acceptingAtEnd.push_back(containsMatch(nodes) || containsMatch(endSet));
+        return id;
+    };
+
+    intern(set);
+    stack.push_back(entry);
+    closure(nfa.nodes, stack, mark, ++stamp, true, false, set);
+    startState = intern(set);
+    stack.push_back(entry);
+    closure(nfa.nodes, stack, mark, ++stamp, true, true, set);
+    matchesEmpty = containsMatch(set);
+
+    for (uint32_t state = 0; state < stateSets.size(); ++state) {
+        if (stateSets.size() > MAX_STATES) {
+            transitions.clear();
+            accepting.clear();
+            acceptingAtEnd.clear();
+            error = "pattern needs more than " + std::to_string(MAX_STATES) + " states";
+            return false;
+        }
+        transitions.resize((state + 1) * classCount, state);
+        if (state == DEAD_STATE || accepting[state]) continue; // Both stay where they are
+
+        for (size_t symbolClassId = 0; symbolClassId < classCount; ++symbolClassId) {
+            size_t symbol = representative[symbolClassId];
+            for (uint32_t node : stateSets[state]) {
+                const NfaNode& current = nfa.nodes[node];
+                if (current.kind == NfaNode::Kind::Symbols && nfa.sets[current.set][symbol]) stack.push_back(current.out);
+            }
+            closure(nfa.nodes, stack, mark, ++stamp, false, false, set);
+            transitions[state * classCount + symbolClassId] = intern(set);
+        }
+    }
+
+    // Renumber the dead and accepting states first, so the match loop leaves on a single compare,
+    // and store every target as its row offset in the table
+    size_t stateTotal = accepting.size();
+    std::vector<uint32_t> order(stateTotal), newId(stateTotal);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_partition(order.begin(), order.end(), [&](uint32_t state) { return state == DEAD_STATE || accepting[state]; });
+    terminalStates = 0;
+    for (uint32_t state = 0; state < stateTotal; ++state) {
+        newId[order[state]] = state;
+        if (order[state] == DEAD_STATE || accepting[order[state]]) ++terminalStates;
+    }
+
+    std::vector<uint32_t> offsets(transitions.size());
+    std::vector<uint8_t> newAccepting(stateTotal), newAcceptingAtEnd(stateTotal);
+    for (uint32_t state = 0; state < stateTotal; ++state) {
+        uint32_t target = newId[state];
+        newAccepting[target] = accepting[state];
+        newAcceptingAtEnd[target] = acceptingAtEnd[state];
+        for (size_t symbolClassId = 0; symbolClassId < classCount; ++symbolClassId) {
+            offsets[target * classCount + symbolClassId] = static_cast<uint32_t>(newId[transitions[state * classCount + symbolClassId]] * classCount);
+        }
+    }
+    transitions = std::move(offsets);
+    accepting = std::move(newAccepting);
+    acceptingAtEnd = std::move(newAcceptingAtEnd);
+    startState = static_cast<uint32_t>(newId[startState] * classCount);
+    return true;
+}
+
+
+// Function to run a row through the DFA, leaving as soon as the outcome is known
+bool PatternDfa::matches(std::string_view row) const {
+    if (accepting.empty()) return false;
+    if (row.empty()) return matchesEmpty;
+    const uint32_t* table = transitions.data();
+    const uint32_t terminalLimit = static_cast<uint32_t>(terminalStates * classCount);
+    uint32_t state = startState;
+    for (unsigned char c : row) {
+        if (state < terminalLimit) return accepting[state / classCount];
+        state = table[state + symbolClass[c]];
+    }
+    return acceptingAtEnd[state / classCount];
+}
+
+
+// CASE FOLDING
+
+// Unicode simple case folding of the Latin, Greek, Cyrillic, Armenian and Georgian letters in common use
+// and of the fullwidth forms. No mapping makes the UTF-8 of a letter longer, so folded rows are never
+// longer than the raw ones.
+
+namespace {
+
+// Base letter of the lowercase precomposed letters, '.' keeps the letter
+constexpr char LATIN1_BASES[] = "aaaaaa.ceeeeiiii.nooooo.ouuuuy.y";                   // U+00E0 to U+00FF
+constexpr char LATIN_EXTENDED_A_BASES[] =                                              // U+0100 to U+017F
+    "aaaaaaccccccccdd.deeeeeeeeeegggg" "gggghh.hiiiiiiiiii..jjkk.llllll."
+    "l.lnnnnnn...oooooo..rrrrrrssssss" "sstttt.tuuuuuuuuuuuuwwyyyzzzzzz.";
+constexpr char PINYIN_BASES[] = "aaiioouuuuuuuuuu";                                     // U+01CD to U+01DC
+constexpr char LATIN_EXTENDED_ADDITIONAL_BASES[] =                                     // U+1E00 to U+1EFF
+    "aabbbbbbccddddddddddeeeeeeeeeeff" "gghhhhhhhhhhiiiikkkkkkllllllllmm"
+    "mmmmnnnnnnnnoooooooopppprrrrrrrr" "ssssssssssttttttttuuuuuuuuuuvvvv"
+    "wwwwwwwwwwxxxxyyzzzzzzhtwy......" "aaaaaaaaaaaaaaaaaaaaaaaaeeeeeeee"
+    "eeeeeeeeiiiioooooooooooooooooooo" "oooouuuuuuuuuuuuuuyyyyyyyy......";
+
+// Greek and Cyrillic letters with a tonos, dialytika, breve or diaeresis, with their base letters
+constexpr std::pair<uint16_t, uint16_t> GREEK_CYRILLIC_BASES[] = {
+    {0x390, 0x3B9}, {0x3AC, 0x3B1}, {0x3AD, 0x3B5}, {0x3AE, 0x3B7}, {0x3AF, 0x3B9}, {0x3B0, 0x3C5}, {0x3CA, 0x3B9},
+    {0x3CB, 0x3C5}, {0x3CC, 0x3BF}, {0x3CD, 0x3C5}, {0x3CE, 0x3C9}, {0x439, 0x438}, {0x450, 0x435}, {0x451, 0x435},
+    {0x453, 0x433}, {0x457, 0x456}, {0x45C, 0x43A}, {0x45D, 0x438}, {0x45E, 0x443}, {0x477, 0x475}, {0x4C2, 0x436},
+    {0x4D1, 0x430}, {0x4D3, 0x430}, {0x4D7, 0x435}, {0x4DB, 0x4D9}, {0x4DD, 0x436}, {0x4DF, 0x437}, {0x4E3, 0x438},
+    {0x4E5, 0x438}, {0x4E7, 0x43E}, {0x4EB, 0x4E9}, {0x4ED, 0x44D}, {0x4EF, 0x443}, {0x4F1, 0x443}, {0x4F3, 0x443},
+    {0x4F5, 0x447}, {0x4F9, 0x44B}};
+
+
+// Function to fold a code point whose upper and lower case alternate, upperParity is the parity of the uppercase ones
+inline uint32_t foldAlternating(uint32_t c, uint32_t upperParity) {
+    return (c & 1) == upperParity ? c + 1 : c;
+}
+
+
+// Function to map a code point to its simple case folding, code points without one map to themselves
+uint32_t foldCodepoint(uint32_t c) {
+    if (c < 0x80) return (c >= 'A' && c <= 'Z') ? c + 32 : c;
+    if (c < 0x100) {
+        if (c == 0xB5) return 0x3BC;                                 // Micro sign to mu
+        return (c >= 0xC0 && c <= 0xDE && c != 0xD7) ? c + 32 : c;
+    }
+    if (c < 0x180) {
+        if (c == 0x130 || c == 0x131 || c == 0x138 || c == 0x149) return c;
+        if (c == 0x178) return 0xFF;
+        if (c == 0x17F) return 's';
+        if ((c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E)) return foldAlternating(c, 1);
+        return foldAlternating(c, 0);
+    }
+    if (c < 0x250) {
+        if (c >= 0x1C4 && c <= 0x1CC) return 0x1C6 + (c - 0x1C4) / 3 * 3; // DŽ, LJ and NJ with their titlecase forms
+        if (c == 0x1F1 || c == 0x1F2) return 0x1F3;
+        if (c >= 0x1CD && c <= 0x1DC) return foldAlternating(c, 1);
+        if ((c >= 0x1DE && c <= 0x1EF) || c == 0x1F4 || (c >= 0x1F8 && c <= 0x21F) || (c >= 0x222 && c <= 0x233)) return foldAlternating(c, 0);
+        return c;
+    }
+    if (c >= 0x370 && c < 0x400) {
+        if (c == 0x386) return 0x3AC;
+        if (c >= 0x388 && c <= 0x38A) return c + 37;
+        if (c == 0x38C) return 0x3CC;
+        if (c == 0x38E || c == 0x38F) return c + 63;
+        if ((c >= 0x391 && c <= 0x3A1) || (c >= 0x3A3 && c <= 0x3AB)) return c + 32;
+        if (c == 0x3C2) return 0x3C3;                                // Final sigma
+        if (c == 0x3D0) return 0x3B2;
+        if (c == 0x3D1 || c == 0x3F4) return 0x3B8;
+        if (c == 0x3D5) return 0x3C6;
+        if (c == 0x3D6) return 0x3C0;
+        if (c == 0x3F0) return 0x3BA;
+        if (c == 0x3F1) return 0x3C1;
+        if (c == 0x3F5) return 0x3B5;
+        if (c >= 0x3D8 && c <= 0x3EF) return foldAlternating(c, 0);
+        return c;
+    }
+    if (c >= 0x400 && c < 0x530) {
+        if (c < 0x410) return c + 80;
+        if (c < 0x430) return c + 32;
+        if ((c >= 0x460 && c <= 0x481) || (c >= 0x48A && c <= 0x4BF) || c >= 0x4D0) return foldAlternating(c, 0);
+        if (c == 0x4C0) return 0x4CF;
+        if (c >= 0x4C1 && c <= 0x4CE) return foldAlternating(c, 1);
+        return c;
+    }
+    if (c >= 0x531 && c <= 0x556) return c + 48;                    // Armenian
+    if (c >= 0x10A0 && c <= 0x10C5) return c + 0x1C60;              // Georgian Asomtavruli to Nuskhuri
+    if (c >= 0x1E00 && c < 0x1F00) {
+        if (c == 0x1E9E) return 0xDF;                                // Capital sharp s
+        if (c <= 0x1E95 || c >= 0x1EA0) return foldAlternating(c, 0);
+        return c;
+    }
+    if (c >= 0x1F00 && c < 0x2000) {
+        uint32_t low = c & 0xF;
+        uint32_t row = c & 0xFFF0;
+        if (low >= 8 && (row == 0x1F00 || row == 0x1F10 || row == 0x1F20 || row == 0x1F30 || row == 0x1F40 || row == 0x1F60 || row == 0x1F80 || row == 0x1F90 || row == 0x1FA0)) {
+            if ((row == 0x1F10 || row == 0x1F40) && low >= 0xE) return c;
+            return c - 8;
+        }
+        if (row == 0x1F50 && low >= 8 && (low & 1)) return c - 8;
+        if (c == 0x1FB8 || c == 0x1FB9 || c == 0x1FD8 || c == 0x1FD9 || c == 0x1FE8 || c == 0x1FE9) return c - 8;
+        if (c == 0x1FBC || c == 0x1FCC || c == 0x1FFC) return c - 9;
+        if (c == 0x1FEC) return 0x1FE5;
+        if (c == 0x1FBA || c == 0x1FBB) return c - 0x4A;
+        if (c >= 0x1FC8 && c <= 0x1FCB) return c - 0x56;
+        if (c == 0x1FDA || c == 0x1FDB) return c - 0x64;
+        if (c == 0x1FEA || c == 0x1FEB) return c - 0x70;
+        if (c == 0x1FF8 || c == 0x1FF9) return c - 0x80;
+        if (c == 0x1FFA || c == 0x1FFB) return c - 0x7E;
+        if (c == 0x1FBE) return 0x3B9;
+        return c;
+    }
+    if (c == 0x2126) return 0x3C9;                                   // Ohm sign to omega
+    if (c == 0x212A) return 'k';                                     // Kelvin sign
+    if (c == 0x212B) return 0xE5;                                    // Angstrom sign
+    if (c >= 0x2160 && c <= 0x216F) return c + 16;                  // Roman numerals
+    if (c >= 0x24B6 && c <= 0x24CF) return c + 26;                  // Circled letters
+    if (c >= 0xFF21 && c <= 0xFF3A) return c + 32;                  // Fullwidth letters
+    return c;
+}
+
+
+// Function to map a folded letter to its letter without diacritics
+uint32_t baseLetter(uint32_t c) {
+    char base = '.';
+    if (c >= 0xE0 && c < 0x100) base = LATIN1_BASES[c - 0xE0];
+    else if (c >= 0x100 && c < 0x180) base = LATIN_EXTENDED_A_BASES[c - 0x100];
+    else if (c >= 0x1CD && c <= 0x1DC) base = PINYIN_BASES[c - 0x1CD];
+    else if (c >= 0x218 && c <= 0x21B) base = c < 0x21A ? 's' : 't';   // Comma below
+    else if (c >= 0x1E00 && c < 0x1F00) base = LATIN_EXTENDED_ADDITIONAL_BASES[c - 0x1E00];
+    else if (c >= 0x390 && c < 0x500) {
+        auto found = std::lower_bound(std::begin(GREEK_CYRILLIC_BASES), std::end(GREEK_CYRILLIC_BASES), std::make_pair(static_cast<uint16_t>(c), uint16_t(0)));
+        if (found != std::end(GREEK_CYRILLIC_BASES) && found->first == c) return found->second;
+    }
+    return base == '.' ? c : static_cast<uint32_t>(base);
+}
+
+
+// Function to tell combining diacritical marks apart, they are dropped with the diacritics
+inline bool isCombiningMark(uint32_t c) {
+    return (c >= 0x300 && c <= 0x36F) || (c >= 0x1AB0 && c <= 0x1AFF) || (c >= 0x1DC0 && c <= 0x1DFF) ||
+           (c >= 0x20D0 && c <= 0x20FF) || (c >= 0xFE20 && c <= 0xFE2F);
+}
+
+
+// Function to decode the UTF-8 sequence starting at text[i], length 0 for a byte that does not start a valid one
+uint32_t decodeUtf8(std::string_view text, size_t i, size_t& length) {
+    unsigned char lead = static_cast<unsigned char>(text[i]);
+    uint32_t c;
+    uint32_t minimum;
+    if (lead >= 0xC2 && lead <= 0xDF) { length = 2; c = lead & 0x1F; minimum = 0x80; }
+    else if (lead >= 0xE0 && lead <= 0xEF) { length = 3; c = lead & 0x0F; minimum = 0x800; }
+    else if (lead >= 0xF0 && lead <= 0xF4) { length = 4; c = lead & 0x07; minimum = 0x10000; }
+    else { length = 0; return lead; }
+
+    if (i + length > text.size()) { length = 0; return lead; }
+    for (size_t k = 1; k < length; ++k) {
+        unsigned char next = static_cast<unsigned char>(text[i + k]);
+        if ((next & 0xC0) != 0x80) { length = 0; return lead; }
+        c = (c << 6) | (next & 0x3F);
+    }
+    if (c < minimum || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) { length = 0; return lead; }
+    return c;
+}
+
+
+// Function to write a code point as UTF-8, returns the position after it
+char* writeUtf8(uint32_t c, char* out) {
+    if (c < 0x80) {
+        *out++ = static_cast<char>(c);
+    } else if (c < 0x800) {
+        *out++ = static_cast<char>(0xC0 | (c >> 6));
+        *out++ = static_cast<char>(0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+        *out++ = static_cast<char>(0xE0 | (c >> 12));
+        *out++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (c & 0x3F));
+    } else {
+        *out++ = static_cast<char>(0xF0 | (c >> 18));
+        *out++ = static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+        *out++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (c & 0x3F));
+    }
+    return out;
+}
+
+
+// Function to lowercase 8 ASCII bytes at once: a byte gets 0x20 added when it lies in 'A' to 'Z'
+inline uint64_t foldAsciiWord(uint64_t word) {
+    constexpr uint64_t ONES = 0x0101010101010101ULL;
+    uint64_t atLeastA = word + (0x80 - 'A') * ONES;     // High bit set where byte >= 'A'
+    uint64_t aboveZ = word + (0x80 - 'Z' - 1) * ONES;   // High bit set where byte > 'Z'
+    return word | (((atLeastA & ~aboveZ) & (0x80 * ONES)) >> 2);
+}
+
+} // namespace
+
+
+// Function to append the folded form of UTF-8 text, bytes that are not valid UTF-8 are copied as they are.
+// The folded text is never longer, so it is written straight into out and out is trimmed afterwards.
+void appendFolded(std::string_view text, std::string& out, bool stripMarks, bool foldAscii) {
+    size_t start = out.size();
+    out.resize(start + text.size());
+    char* destination = &out[start];
+    const char* source = text.data();
+    const char* end = source + text.size();
+
+    while (source < end) {
+        // Whole words of ASCII bytes, nearly every path is made of them
+        uint64_t word;
+        if (end - source >= 8 && (std::memcpy(&word, source, 8), (word & 0x8080808080808080ULL) == 0)) {
+            if (foldAscii) word = foldAsciiWord(word);
+            std::memcpy(destination, &word, 8);
+            source += 8;
+            destination += 8;
+            continue;
+        }
+
+        unsigned char c = static_cast<unsigned char>(*source);
+        if (c < 0x80) {
+            *destination++ = static_cast<char>((foldAscii && c >= 'A' && c <= 'Z') ? c + 32 : c);
+            ++source;
+            continue;
+        }
+
+        size_t length = 0;
+        uint32_t codepoint = decodeUtf8(text, source - text.data(), length);
+        if (length == 0) {
+            *destination++ = static_cast<char>(c);
+            ++source;
+            continue;
+        }
+        source += length;
+
+        codepoint = foldCodepoint(codepoint);
+        if (stripMarks) {
+            if (isCombiningMark(codepoint)) continue;
+            codepoint = baseLetter(codepoint);
+        }
+        destination = writeUtf8(codepoint, destination);
+    }
+    out.resize(destination - out.data());
+}
+
+
+// Function to fold text into a new string
+std::string foldedText(std::string_view text, bool stripMarks) {
+    std::string folded;
+    folded.reserve(text.size());
+    appendFolded(text, folded, stripMarks);
+    return folded;
+}
+
+
+// SEARCH INDEX
+
+// Function to append the filter form of a path without building temporaries
+void appendNormalized(const std::string& input, std::string& out, bool stripMarks) {
+    size_t start = 0;
+    for (size_t i = 0; i < input.length(); ++i) {
+        if (input[i] == '\033' && i + 1 < input.length() && input[i+1] == '[') {
+            appendFolded(std::string_view(input).substr(start, i - start), out, stripMarks);
+            // Skip the entire ANSI escape sequence, including its final letter
+            while (i < input.length() && !isalpha(input[i])) {
+                ++i;
+            }
+            start = i + 1;
+        }
+    }
+    if (start < input.length()) {
+        appendFolded(std::string_view(input).substr(start), out, stripMarks);
+    }
+}
+
+
+// Function to hash a raw list, rows are separated so ["ab","c"] and ["a","bc"] differ
+uint64_t SearchIndex::fingerprint(const std::vector<std::string>& files) {
+    uint64_t hash = 0xcbf29ce484222325ULL; // FNV-1a
+    for (const auto& file : files) {
+        for (unsigned char c : file) {
+            hash = (hash ^ c) * 0x100000001b3ULL;
+        }
+        hash = (hash ^ 0xff) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+
+// Function to build the normalized rows for a list
+void SearchIndex::buildRows(const std::vector<std::string>& files) {
+    size_t totalBytes = 0;
+    for (const auto& file : files) {
+        totalBytes += file.size();
+    }
+
+    buffer.clear();
+    buffer.reserve(totalBytes + SUBSTRING_PADDING); // Normalized rows are never longer than the raw ones
+    offsets.clear();
+    offsets.reserve(files.size() + 1);
+    offsets.push_back(0);
+    for (const auto& file : files) {
+        appendNormalized(file, buffer, stripMarks);
+        offsets.push_back(buffer.size());
+    }
+    buffer.append(SUBSTRING_PADDING, '\0'); // Vector loads may run past the last row
+    listFingerprint = fingerprint(files);
+}
+
+
+// Function to build the index for a list
+void SearchIndex::build(const std::vector<std::string>& files) {
+    buildRows(files);
+    if (trigrams) {
+        trigrams->build(*this, trigramThreads);
+    }
+}
+
+
+// Function to follow a reloaded list, reloads that did not change anything keep the index as is
+void SearchIndex::sync(const std::vector<std::string>& files) {
+    if (!offsets.empty() && size() == files.size() && listFingerprint == fingerprint(files)) {
+        return;
+    }
+    if (!trigrams || offsets.empty()) {
+        build(files);
+        return;
+    }
+
+    // The previous rows stay alive until the trigram index has carried its documents over
+    SearchIndex previous;
+    previous.buffer.swap(buffer);
+    previous.offsets.swap(offsets);
+    buildRows(files);
+    if (!trigrams->update(previous, *this)) {
+        trigrams->build(*this, trigramThreads);
+    }
+}
+
+
+// Function to drop the index
+void SearchIndex::clear() {
+    buffer.clear();
+    offsets.clear();
+    listFingerprint = 0;
+    if (trigrams) {
+        trigrams = std::make_unique<TrigramIndex>();
+    }
+}
+
+
+// Function to choose whether rows keep their diacritics, the rows are built again on the next build or sync
+void SearchIndex::setStripMarks(bool strip) {
+    if (strip != stripMarks) {
+        stripMarks = strip;
+        clear();
+    }
+}
+
+
+// Function to start keeping a trigram index, rows already loaded are indexed now
+void SearchIndex::enableTrigrams(size_t threads) {
+    trigramThreads = std::max<size_t>(1, threads);
+    if (!trigrams) {
+        trigrams = std::make_unique<TrigramIndex>();
+        trigrams->build(*this, trigramThreads);
+    }
+}
+
+
+// Function to stop keeping a trigram index and free it
+void SearchIndex::disableTrigrams() {
+    trigrams.reset();
+    trigramThreads = 0;
+}
+
+
+// TRIGRAM INDEX
+
+// Rows per build task, smaller lists are indexed on the calling thread
+static constexpr size_t MIN_ROWS_PER_BUILD_TASK = 16384;
+
+// Function to pack three bytes into a trigram key
+static inline uint32_t trigramAt(const char* p) {
+    return static_cast<uint32_t>(static_cast<unsigned char>(p[0])) |
+           static_cast<uint32_t>(static_cast<unsigned char>(p[1])) << 8 |
+           static_cast<uint32_t>(static_cast<unsigned char>(p[2])) << 16;
+}
+
+
+// Function to collect the distinct trigrams of a text, sorted
+static void distinctTrigrams(std::string_view text, std::vector<uint32_t>& out) {
+    out.clear();
+    for (size_t i = 0; i + 3 <= text.size(); ++i) {
+        out.push_back(trigramAt(text.data() + i));
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+
+// Function to keep the ids of sorted list a that also appear in the longer sorted list b
+static void intersectInPlace(std::vector<uint32_t>& a, const uint32_t* b, size_t bSize) {
+    size_t kept = 0;
+    size_t low = 0;
+    for (uint32_t id : a) {
+        // Gallop from the last position, neighbouring ids are usually close together in b
+        size_t step = 1;
+        size_t high = low;
+        while (high < bSize && b[high] < id) {
+            low = high + 1;
+            high += step;
+            step *= 2;
+        }
+        low = std::lower_bound(b + low, b + std::min(high, bSize), id) - b;
+        if (low == bSize) break;
+        if (b[low] == id) a[kept++] = id;
+    }
+    a.resize(kept);
+}
+
+
+// Function to run one task per block, on the calling thread when there is a single block
+template <typename Task>
+static void runBlockTasks(size_t numTasks, const Task& task) {
+    if (numTasks == 1) {
+        task(0);
+        return;
+    }
+    std::vector<std::future<void>> futures;
+    for (size_t i = 0; i < numTasks; ++i) {
+        futures.push_back(std::async(std::launch::async, task, i));
+    }
+    for (auto& future : futures) {
+        future.get();
+    }
+}
+
+
+// Function to index every row from scratch
+void TrigramIndex::build(const SearchIndex& rows, size_t threads) {
+    const size_t rowCount = rows.size();
+    docRow.resize(rowCount);
+    rowDoc.resize(rowCount);
+    for (size_t i = 0; i < rowCount; ++i) {
+        docRow[i] = rowDoc[i] = static_cast<uint32_t>(i);
+    }
+    removedDocs = 0;
+    appended.clear();
+
+    const size_t numTasks = std::max<size_t>(1, std::min(threads, rowCount / MIN_ROWS_PER_BUILD_TASK));
+    const size_t blockSize = (rowCount + numTasks - 1) / numTasks;
+    auto blockRange = [&](size_t task) {
+        return std::make_pair(std::min(rowCount, task * blockSize), std::min(rowCount, (task + 1) * blockSize));
+    };
+
+    // Pass 1: each block marks the trigrams it contains
+    std::vector<std::vector<uint64_t>> blockPresent(numTasks);
+    runBlockTasks(numTasks, [&](size_t task) {
+        std::vector<uint64_t>& bits = blockPresent[task];
+        bits.assign(TRIGRAM_WORDS, 0);
+        auto [begin, end] = blockRange(task);
+        for (size_t i = begin; i < end; ++i) {
+            std::string_view text = rows.row(i);
+            for (size_t j = 0; j + 3 <= text.size(); ++j) {
+                uint32_t gram = trigramAt(text.data() + j);
+                bits[gram >> 6] |= uint64_t(1) << (gram & 63);
+            }
+        }
+    });
+
+    // Dense ids are ranks in the merged bitmap, so the postings need no hash table
+    present.assign(TRIGRAM_WORDS, 0);
+    rankBase.assign(TRIGRAM_WORDS, 0);
+    for (auto& bits : blockPresent) {
+        for (size_t w = 0; w < TRIGRAM_WORDS; ++w) {
+            present[w] |= bits[w];
+        }
+        std::vector<uint64_t>().swap(bits);
+    }
+    uint32_t distinct = 0;
+    for (size_t w = 0; w < TRIGRAM_WORDS; ++w) {
+        rankBase[w] = distinct;
+        distinct += static_cast<uint32_t>(__builtin_popcountll(present[w]));
+    }
+
+    // Pass 2: each block counts the rows of every trigram, a row counts once per trigram
+    std::vector<std::vector<size_t>> cursors(numTasks);
+    auto forEachRowTrigram = [&](size_t task, const auto& visit) {
+        std::vector<uint32_t> lastRow(distinct, REMOVED);
+        auto [begin, end] = blockRange(task);
+        for (size_t i = begin; i < end; ++i) {
+            std::string_view text = rows.row(i);
+            for (size_t j = 0; j + 3 <= text.size(); ++j) {
+                uint32_t id = 0;
+                denseId(trigramAt(text.data() + j), id);
+                if (lastRow[id] != i) {
+                    lastRow[id] = static_cast<uint32_t>(i);
+                    visit(id, static_cast<uint32_t>(i));
+                }
+            }
+        }
+    };
+    runBlockTasks(numTasks, [&](size_t task) {
+        std::vector<size_t>& counts = cursors[task];
+        counts.assign(distinct, 0);
+        forEachRowTrigram(task, [&counts](uint32_t id, uint32_t) { ++counts[id]; });
+    });
+
+    // Within a trigram the blocks follow each other in row order, which keeps every list ascending
+    starts.assign(static_cast<size_t>(distinct) + 1, 0);
+    size_t total = 0;
+    for (uint32_t id = 0; id < distinct; ++id) {
+        starts[id] = total;
+        for (auto& counts : cursors) {
+            size_t count = counts[id];
+            counts[id] = total;
+            total += count;
+        }
+    }
+    starts[distinct] = total;
+
+    // Pass 3: each block writes its rows into its own slices of the shared array
+    ids.assign(total, 0);
+    runBlockTasks(numTasks, [&](size_t task) {
+        std::vector<size_t>& cursor = cursors[task];
+        forEachRowTrigram(task, [this, &cursor](uint32_t id, uint32_t row) { ids[cursor[id]++] = row; });
+    });
+}
+
+
+// Function to map a trigram of the built rows to its dense id
+bool TrigramIndex::denseId(uint32_t trigram, uint32_t& id) const {
+    if (present.empty()) return false;
+    uint64_t word = present[trigram >> 6];
+    uint64_t bit = uint64_t(1) << (trigram & 63);
+    if (!(word & bit)) return false;
+    id = rankBase[trigram >> 6] + static_cast<uint32_t>(__builtin_popcountll(word & (bit - 1)));
+    return true;
+}
+
+
+// Function to move documents of unchanged rows to their new rows and index only the new rows
+bool TrigramIndex::update(const SearchIndex& previousRows, const SearchIndex& rows) {
+    if (previousRows.size() != rowDoc.size()) return false;
+
+    // Identical normalized rows are interchangeable, any of their documents can be reused
+    std::unordered_multimap<std::string_view, uint32_t> previousDocs;
+    previousDocs.reserve(previousRows.size());
+    for (size_t i = 0; i < previousRows.size(); ++i) {
+        previousDocs.emplace(previousRows.row(i), rowDoc[i]);
+    }
+
+    std::vector<uint32_t> newRowDoc(rows.size(), REMOVED);
+    std::vector<size_t> addedRows;
+    for (size_t i = 0; i < rows.size(); ++i) {
+        auto it = previousDocs.find(rows.row(i));
+        if (it == previousDocs.end()) {
+            addedRows.push_back(i);
+        } else {
+            newRowDoc[i] = it->second;
+            previousDocs.erase(it);
+        }
+    }
+
+    // Large changes or too many stale ids in the postings are cheaper to rebuild
+    if (addedRows.size() > rows.size() / 4 || removedDocs + previousDocs.size() > rows.size() / 2 ||
+        docRow.size() + addedRows.size() >= REMOVED) {
+        return false;
+    }
+
+    for (const auto& entry : previousDocs) {
+        docRow[entry.second] = REMOVED;
+    }
+    removedDocs += previousDocs.size();
+
+    // New documents get the highest ids, so they always sort after the built postings
+    std::vector<uint32_t> grams;
+    for (size_t i : addedRows) {
+        uint32_t doc = static_cast<uint32_t>(docRow.size());
+        docRow.push_back(REMOVED);
+        newRowDoc[i] = doc;
+        distinctTrigrams(rows.row(i), grams);
+        for (uint32_t gram : grams) {
+            appended[gram].push_back(doc);
+        }
+    }
+
+    for (size_t i = 0; i < newRowDoc.size(); ++i) {
+        docRow[newRowDoc[i]] = static_cast<uint32_t>(i);
+    }
+    rowDoc = std::move(newRowDoc);
+    return true;
+}
+
+
+// Function to intersect the posting lists of each token and unite the tokens, shortest lists first
+bool TrigramIndex::candidates(const std::vector<CompiledToken>& tokens, std::vector<uint32_t>& rows) const {
+    for (const CompiledToken& token : tokens) {
+        if (token.text().size() < 3) return false;
+    }
+
+    std::vector<uint32_t> docs;
+    std::vector<uint32_t> grams;
+    std::vector<PostingList> lists;
+    std::deque<std::vector<uint32_t>> joined; // Built postings followed by those of rows added since
+    for (const CompiledToken& token : tokens) {
+        distinctTrigrams(token.text(), grams);
+        lists.clear();
+        bool missing = false;
+        for (uint32_t gram : grams) {
+            PostingList list{nullptr, 0};
+            uint32_t id = 0;
+            if (denseId(gram, id)) {
+                list = PostingList{ids.data() + starts[id], starts[id + 1] - starts[id]};
+            }
+            auto it = appended.find(gram);
+            if (it != appended.end()) {
+                // Added documents have the highest ids, appending keeps the joined list ascending
+                std::vector<uint32_t>& both = joined.emplace_back(list.ids, list.ids + list.size);
+                both.insert(both.end(), it->second.begin(), it->second.end());
+                list = PostingList{both.data(), both.size()};
+            }
+            if (list.size == 0) {
+                missing = true; // No row contains this trigram, so none contains the token
+                break;
+            }
+            lists.push_back(list);
+        }
+        if (missing) continue;
+
+        // Once a list barely narrows the set, verifying the rest is cheaper than probing more lists
+        std::sort(lists.begin(), lists.end(), [](const PostingList& a, const PostingList& b) { return a.size < b.size; });
+        std::vector<uint32_t> tokenDocs(lists.front().ids, lists.front().ids + lists.front().size);
+        for (size_t i = 1; i < lists.size() && !tokenDocs.empty(); ++i) {
+            size_t before = tokenDocs.size();
+            intersectInPlace(tokenDocs, lists[i].ids, lists[i].size);
+            if (tokenDocs.size() > before - before / 8) break;
+        }
+        docs.insert(docs.end(), tokenDocs.begin(), tokenDocs.end());
+
+        // Broad terms match most rows, a plain scan beats gathering and sorting them
+        if (docs.size() > rowDoc.size() / 4) return false;
+    }
+
+    rows.clear();
+    rows.reserve(docs.size());
+    for (uint32_t doc : docs) {
+        if (docRow[doc] != REMOVED) {
+            rows.push_back(docRow[doc]);
+        }
+    }
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+    return true;
+}
+
+
+// Boyer-Moore string search implementation for files
+std::vector<size_t> boyerMooreSearch(const std::string& pattern, const std::string& text) {
+    const size_t patternLen = pattern.length();
+    const size_t textLen = text.length();
+    
+    // Early exit conditions
+    if (patternLen == 0 || textLen == 0 || patternLen > textLen) 
+        return {};
+    
+    // Single character optimization
+    if (patternLen == 1) {
+        std::vector<size_t> matches;
+        for (size_t i = 0; i < textLen; ++i) 
+            if (text[i] == pattern[0]) 
+                matches.push_back(i);
+        return matches;
+    }
+    
+    // Preprocess bad character shifts
+    std::vector<size_t> badCharShifts(256, patternLen);
+    for (size_t i = 0; i < patternLen - 1; ++i) 
+        badCharShifts[static_cast<unsigned char>(pattern[i])] = patternLen - i - 1;
+    
+    // Preprocess good suffix shifts
+    std::vector<size_t> goodSuffixShifts(patternLen, patternLen);
+    std::vector<size_t> suffixLengths(patternLen, 0);
+    
+    // Compute suffix lengths and good suffix shifts
+    suffixLengths[patternLen - 1] = patternLen;
+    size_t lastPrefixPosition = patternLen;
+    
+    for (int i = patternLen - 2; i >= 0; --i) {
+        if (memcmp(pattern.c_str() + i + 1, pattern.c_str() + patternLen - lastPrefixPosition, lastPrefixPosition - (i + 1)) == 0) {
+            suffixLengths[i] = lastPrefixPosition - (i + 1);
+            lastPrefixPosition = i + 1;
+        }
+    }
+    
+    // Update good suffix shifts
+    for (size_t i = 0; i < patternLen; ++i) {
+        if (suffixLengths[i] == i + 1) {
+            for (size_t j = 0; j < patternLen - i - 1; ++j) 
+                if (goodSuffixShifts[j] == patternLen) 
+                    goodSuffixShifts[j] = patternLen - i - 1;
+        }
+        
+        if (suffixLengths[i] > 0) 
+            goodSuffixShifts[patternLen - suffixLengths[i]] = patternLen - i - 1;
+    }
+    
+    // Search phase
+    std::vector<size_t> matches;
+    for (size_t i = 0; i <= textLen - patternLen;) {
+        size_t skip = 0;
+        while (skip < patternLen && pattern[patternLen - 1 - skip] == text[i + patternLen - 1 - skip]) 
+            ++skip;
+        
+        // Pattern found
+        if (skip == patternLen) 
+            matches.push_back(i);
+        
+        // Compute shift
+        size_t badCharShift = (i + patternLen < textLen) 
+            ? badCharShifts[static_cast<unsigned char>(text[i + patternLen - 1])] 
+            : 1;
+        
+        size_t goodSuffixShift = goodSuffixShifts[skip];
+        
+        // Take the maximum shift
+        i += std::max(1ul, std::min(badCharShift, goodSuffixShift));
+    }
+    
+    return matches;
+}
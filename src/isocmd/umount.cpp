@@ -2,18 +2,20 @@
 
 #include "../headers.h"
 #include "../threadpool.h"
+#include "../search.h"
+#include "../mounttable.h"
 
 
-const std::string MOUNTED_ISO_PATH = "/mnt";
+const std::string MOUNTED_ISO_PREFIX = "/mnt/iso_";
 
-bool loadAndDisplayMountedISOs(std::vector<std::string>& isoDirs, std::vector<std::string>& filteredFiles, bool& isFiltered) {
-     isoDirs.clear();
-        for (const auto& entry : std::filesystem::directory_iterator(MOUNTED_ISO_PATH)) {
-            if (entry.is_directory() && entry.path().filename().string().find("iso_") == 0) {
-                isoDirs.push_back(entry.path().string());
-            }
-        }
-        sortFilesCaseInsensitive(isoDirs);
+bool loadAndDisplayMountedISOs(std::vector<std::string>& isoDirs, ListView& view) {
+    // A filtered view finds its mount points again in the reloaded list
+    std::vector<std::string> shownPaths;
+    if (view.isFiltered()) shownPaths = view.paths();
+
+    // Only what is actually mounted, left-over empty /mnt/iso_* directories are not listed
+    globalMountTable.refresh();
+    isoDirs = globalMountTable.mountPointsWithPrefix(MOUNTED_ISO_PREFIX);
 
     // Check if ISOs exist
     if (isoDirs.empty()) {
@@ -29,10 +31,8 @@ bool loadAndDisplayMountedISOs(std::vector<std::string>& isoDirs, std::vector<st
 
     // Display ISOs
     clearScrollBuffer();
-        if (filteredFiles.size() == isoDirs.size()) {
-				isFiltered = false;
-		}
-        printList(isFiltered ? filteredFiles : isoDirs, "MOUNTED_ISOS");
+        view.restorePaths(shownPaths);
+        printList(view, "MOUNTED_ISOS");
 
     return true;
 }
@@ -55,6 +55,11 @@ void unmountISO(const std::vector<std::string>& isoDirs, std::set<std::string>&
     std::vector<std::pair<std::string, int>> unmountResults;
     for (const auto& isoDir : isoDirs) {
         int result = umount2(isoDir.c_str(), MNT_DETACH);
+        if (result == 0) {
+            globalMountTable.noteUnmounted(isoDir);
+            globalMountRegistry.release(isoDir);
+            globalMountReaper.forget(isoDir);
+        }
         unmountResults.emplace_back(isoDir, result);
     }
 
@@ -109,11 +114,11 @@ void unmountISO(const std::vector<std::string>& isoDirs, std::set<std::string>&
 
 
 // Main function to send ISOs for unmount
-void prepareUnmount(const std::string& input, std::vector<std::string>& selectedIsoDirs, std::vector<std::string>& currentFiles, std::set<std::string>& operationFiles, std::set<std::string>& operationFails, std::set<std::string>& uniqueErrorMessages, bool& umountMvRmBreak, bool& verbose) {
+void prepareUnmount(const std::string& input, std::vector<std::string>& selectedIsoDirs, const ListView& currentFiles, std::set<std::string>& operationFiles, std::set<std::string>& operationFails, std::set<std::string>& uniqueErrorMessages, bool& umountMvRmBreak, bool& verbose) {
     std::set<int> selectedIndices;
     
     if (input != "00" && selectedIsoDirs.empty()) {
-        tokenizeInput(input, currentFiles, uniqueErrorMessages, selectedIndices);
+        tokenizeInput(input, currentFiles.size(), uniqueErrorMessages, selectedIndices);
         for (int index : selectedIndices) {
             selectedIsoDirs.push_back(currentFiles[index - 1]);
         }
@@ -184,5 +189,6 @@ void prepareUnmount(const std::string& input, std::vector<std::string>& selected
     // Signal completion and join progress thread
     isComplete.store(true, std::memory_order_release);
     progressThread.join();
+    globalMountRegistry.save();
 }
 
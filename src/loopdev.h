@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#ifndef LOOPDEV_H
+#define LOOPDEV_H
+#include "headers.h"
+
+
+// Loop devices for one mount batch, set up through /dev/loop-control and LOOP_CONFIGURE instead of by libmount.
+// Images are attached read-only with direct I/O, so their data is not cached a second time through the loop device,
+// and with autoclear, so a device detaches itself once its mount is gone or its mount attempt failed.
+class LoopDevicePool {
+public:
+    // Create free devices for up to batchSize images up front, in parallel
+    explicit LoopDevicePool(size_t batchSize);
+    ~LoopDevicePool();
+    LoopDevicePool(const LoopDevicePool&) = delete;
+    LoopDevicePool& operator=(const LoopDevicePool&) = delete;
+
+    // False without loop-control access or LOOP_CONFIGURE (Linux < 5.8), callers then mount with libmount's loop option
+    bool available() const { return controlFd != -1 && configureSupported.load(std::memory_order_relaxed); }
+
+    // Attach an image and return the open device, to be closed once the mount attempt is over, -1 with errno on failure
+    int attach(const std::string& image, std::string& devicePath);
+
+private:
+    static constexpr int MAX_ATTACH_ATTEMPTS = 16; // Devices taken by other processes in between are skipped
+    static constexpr size_t MAX_RESERVED = 4096;
+
+    int takeDevice();
+
+    int controlFd = -1;
+    int firstFree = -1;                            // Free before the pool existed, never removed by it
+    std::mutex mutex;
+    std::vector<int> reserved;                     // Devices this pool created and nobody has used yet, lowest last
+    std::atomic<bool> configureSupported{true};
+};
+
+#endif // LOOPDEV_H
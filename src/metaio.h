@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#ifndef METAIO_H
+#define METAIO_H
+#include "headers.h"
+#include <linux/io_uring.h>
+
+
+// Metadata of one path, as much of it as the scans and the cache validation need
+struct PathStat {
+    int error = ENOENT;   // 0 when the lookup succeeded, errno otherwise
+    mode_t mode = 0;
+    uint64_t size = 0;
+    dev_t dev = 0;
+    ino_t ino = 0;
+    int64_t mtime = 0;    // Seconds since the epoch
+};
+
+
+// Batched asynchronous statx over a raw io_uring, owned by a single thread
+class MetadataRing {
+public:
+    explicit MetadataRing(unsigned depth);
+    ~MetadataRing();
+    MetadataRing(const MetadataRing&) = delete;
+    MetadataRing& operator=(const MetadataRing&) = delete;
+
+    // False when the kernel, seccomp or the config rule out io_uring statx
+    bool available() const { return ringFd != -1; }
+
+    // Stat names relative to dirFd with up to depth requests in flight, results keep the input order
+    // Returns false if the ring failed midway, the caller then falls back to plain stat calls
+    bool statBatch(int dirFd, const std::vector<const char*>& names, int flags, std::vector<PathStat>& results);
+
+private:
+    bool setup();
+    void teardown();
+    bool supportsStatx();
+    int enter(unsigned toSubmit, unsigned minComplete);
+    template <typename Handler> unsigned reapCompletions(Handler&& handle);
+    void abandonBatch(std::vector<struct statx>& buffers, unsigned inFlight);
+
+    unsigned depth;
+    int ringFd = -1;
+
+    void* sqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    void* cqRing = MAP_FAILED;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+};
+
+
+// The calling thread's ring, created on first use with the configured depth
+MetadataRing& threadMetadataRing();
+
+// Stat names relative to dirFd from the calling thread, through its ring or plain fstatat
+void statNamesAt(int dirFd, const std::vector<const char*>& names, int flags, std::vector<PathStat>& results);
+
+// Stat absolute paths, io_uring on the calling thread or a thread pool where it is unavailable
+std::vector<PathStat> statPaths(const std::vector<std::string>& paths);
+
+#endif // METAIO_H
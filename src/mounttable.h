@@ -0,0 +1,157 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#ifndef MOUNTTABLE_H
+#define MOUNTTABLE_H
+#include "headers.h"
+
+
+// What is mounted at a mount point
+struct MountEntry {
+    std::string source;   // Device or image the mount was made from
+    std::string fsType;
+};
+
+// Mount points of this process's namespace, parsed from /proc/self/mountinfo and kept until the kernel
+// reports a change, so a batch of mounts looks its mount points up in O(1) instead of re-reading the table per ISO
+class MountTable {
+public:
+    MountTable() = default;
+    ~MountTable();
+    MountTable(const MountTable&) = delete;
+    MountTable& operator=(const MountTable&) = delete;
+
+    // Re-read the table if mountinfo flagged a change (POLLPRI) since the last read, a single poll otherwise
+    void refresh();
+
+    // Lookups answer from the last refresh plus the changes noted since
+    bool find(const std::string& mountPoint, MountEntry& entry) const;
+    bool contains(const std::string& mountPoint) const;
+    // Mount points that start with prefix, such as Iso Commander's "/mnt/iso_"
+    std::vector<std::string> mountPointsWithPrefix(const std::string& prefix) const;
+
+    // Record this process's own mounts and unmounts without waiting for the next re-read
+    void noteMounted(const std::string& mountPoint, MountEntry entry);
+    void noteUnmounted(const std::string& mountPoint);
+
+private:
+    bool changed();
+    bool readTable(std::unordered_map<std::string, MountEntry>& table);
+
+    mutable std::shared_mutex mutex;
+    std::mutex refreshMutex;          // One re-read at a time, lookups keep answering meanwhile
+    std::unordered_map<std::string, MountEntry> entries;
+    int mountInfoFd = -1;
+    bool loaded = false;              // Cleared by a failed read, so the next refresh reads again
+};
+
+// Mount table shared by mount, umount and the filters
+extern MountTable globalMountTable;
+
+
+// Which ISO is mounted at which /mnt/iso_* mount point, kept across sessions.
+// Mount point names end in a stable XXH64 hash of the ISO path, a name already taken by another ISO
+// gets the hash of the next seed, so the same ISO keeps its mount point for as long as it stays mounted.
+class MountRegistry {
+public:
+    // Mount point of an ISO: the registered one, or the one it would be given
+    std::string mountPointFor(const std::string& isoFile);
+    // ISO mounted at a registered mount point
+    bool isoFor(const std::string& mountPoint, std::string& isoFile);
+
+    // Register the mount point an ISO is about to be mounted at
+    std::string assign(const std::string& isoFile);
+    // Forget a mount point after an unmount or a failed mount
+    void release(const std::string& mountPoint);
+
+    // True if the ISO's registered mount point is in the mount table, as of its last refresh
+    bool isMounted(const std::string& isoFile);
+    // Registered mount points still in the mount table
+    std::vector<std::string> mountedPoints();
+
+    // Write the registry back after a batch of mounts or unmounts
+    void save();
+
+private:
+    static constexpr size_t HASH_CHARS = 5;
+    static constexpr uint64_t MAX_SEEDS = 64;
+
+    static std::string candidate(const std::string& isoFile, uint64_t seed);
+    std::string freeCandidateLocked(const std::string& isoFile) const;
+    void load();
+
+    std::once_flag loadOnce;
+    std::shared_mutex mutex;
+    std::unordered_map<std::string, std::string> mountPoints; // ISO path to mount point
+    std::unordered_map<std::string, std::string> isoFiles;    // Mount point to ISO path
+    bool dirty = false;
+};
+
+// Registry of the ISOs mounted by Iso Commander
+extern MountRegistry globalMountRegistry;
+
+
+// Last use of every ISO mounted by Iso Commander, so a capped mount set and the idle timeout unmount
+// the least recently used mounts first. Opens are reported by a fanotify mount mark where the kernel allows it,
+// otherwise a mount counts as used when it was mounted. Mounts with open files are never unmounted.
+class IdleMountReaper {
+public:
+    IdleMountReaper() = default;
+    ~IdleMountReaper();
+    IdleMountReaper(const IdleMountReaper&) = delete;
+    IdleMountReaper& operator=(const IdleMountReaper&) = delete;
+
+    // Apply the mount cap (0 is unlimited) and idle timeout (0 keeps idle mounts), either starts the background thread
+    void configure(size_t maxMounted, std::chrono::minutes idleTime);
+
+    // Unmount idle mounts, least recently used first, until wanted more fit under the cap.
+    // Mount points in keep stay mounted. Returns how many of wanted may be mounted.
+    size_t reserve(size_t wanted, const std::unordered_set<std::string>& keep);
+
+    // Start tracking a mount made by this process, or stop after it was unmounted elsewhere
+    void watch(const std::string& mountPoint);
+    void forget(const std::string& mountPoint);
+
+private:
+    using Clock = std::chrono::steady_clock;
+    struct TrackedMount {
+        Clock::time_point lastUsed;
+        dev_t device = 0;
+    };
+
+    void seed();
+    bool tracking() const { return maxMounted > 0 || idleTime.count() > 0; }
+    void watchLocked(const std::string& mountPoint);
+    void markLocked(const std::string& mountPoint);
+    void forgetLocked(const std::string& mountPoint);
+    void drainEventsLocked();
+    size_t evictLocked(size_t count, const std::unordered_set<std::string>& keep, Clock::duration minIdle);
+    void reapLoop();
+
+    std::once_flag seedOnce;
+    std::mutex mutex;
+    std::unordered_map<std::string, TrackedMount> mounts; // Mount point to its last use
+    std::unordered_map<dev_t, std::string> devices;       // Device of a mounted filesystem to its mount point
+    size_t maxMounted = 0;
+    std::chrono::minutes idleTime{0};
+    int fanotifyFd = -1;              // Set once, before the background thread starts
+
+    std::thread reaper;               // Timestamps opens as they happen and unmounts mounts past the idle timeout
+    int wakeFd = -1;                  // eventfd waking the thread after a settings change or to stop it
+    bool stopping = false;
+};
+
+// Idle tracking of the ISOs mounted by Iso Commander
+extern IdleMountReaper globalMountReaper;
+
+
+// Mount settings read from the user config
+struct MountRules {
+    bool newMountApi = false;         // Mount through fsopen/fsmount/move_mount where the kernel has them, opt-in until benchmarked
+    size_t maxMounted = 0;            // Most ISOs mounted at once, 0 is unlimited
+    unsigned idleUnmountMinutes = 0;  // Unmount ISOs unused for this long, 0 keeps them mounted
+};
+
+// Load mount settings, defaults are used for missing keys
+MountRules loadMountRules();
+
+#endif // MOUNTTABLE_H
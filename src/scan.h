@@ -0,0 +1,243 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#ifndef SCAN_H
+#define SCAN_H
+#include "headers.h"
+
+
+// Pruning rules shared by ImportISO, AutoImportISO and the BIN/MDF/NRG search
+struct ScanRules {
+    bool skipPseudoFs = true;               // Skip proc, sysfs, cgroup, devtmpfs, other virtual filesystems and /dev
+    bool skipIsoMounts = true;              // Skip isocmd's own /mnt/iso_* mount points
+    bool sameFilesystem = false;            // Do not cross filesystem boundaries below a root
+    bool followSymlinks = false;            // Descend into symlinked directories, cycles are cut by (dev, ino)
+    bool canonicalPaths = false;            // Store ISO paths resolved with realpath
+    bool magicProbe = false;                // Confirm extension matches by reading image signatures
+    unsigned ioUringDepth = 256;            // statx requests kept in flight per thread, 0 disables io_uring
+    int backgroundNice = 19;                // Nice level of the AutoImportISO threads
+    bool backgroundIdleIo = true;           // Run AutoImportISO in the idle I/O class
+    unsigned backgroundDirsPerSecond = 0;   // AutoImportISO directory rate limit, 0 is unlimited
+    unsigned backgroundMegabytesPerSecond = 0; // AutoImportISO directory listing rate limit in MB/s, 0 is unlimited
+    std::vector<std::string> excludeGlobs;  // fnmatch patterns matched against full paths
+};
+
+// Load pruning rules from the user config, defaults are used for missing keys
+ScanRules loadScanRules();
+
+
+// Thread-safe set of visited directories keyed by (st_dev, st_ino), shared by the walkers of one import
+class VisitedDirectories {
+public:
+    bool insert(dev_t dev, ino_t ino);
+
+private:
+    struct KeyHash {
+        size_t operator()(const std::pair<dev_t, ino_t>& key) const {
+            return std::hash<uint64_t>()(static_cast<uint64_t>(key.second) * 0x9E3779B97F4A7C15ULL ^ key.first);
+        }
+    };
+
+    static constexpr size_t SHARD_COUNT = 16;
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::unordered_set<std::pair<dev_t, ino_t>, KeyHash> keys;
+    };
+    std::array<Shard, SHARD_COUNT> shards;
+};
+
+
+// Number of foreground mount, copy/move/remove and convert operations in progress
+extern std::atomic<int> foregroundOperations;
+
+// Marks a foreground operation for its lifetime, AutoImportISO pauses meanwhile
+class ForegroundActivity {
+public:
+    ForegroundActivity() { foregroundOperations.fetch_add(1, std::memory_order_relaxed); }
+    ~ForegroundActivity() { foregroundOperations.fetch_sub(1, std::memory_order_relaxed); }
+    ForegroundActivity(const ForegroundActivity&) = delete;
+    ForegroundActivity& operator=(const ForegroundActivity&) = delete;
+};
+
+
+// Shared rate limit and pause point for the AutoImportISO walkers, token buckets refilled once per call
+class BackgroundThrottle {
+public:
+    explicit BackgroundThrottle(const ScanRules& rules);
+
+    // Called before a directory is read, sleeps while a foreground operation runs or the budget is spent
+    void beforeDirectory();
+    // Account the getdents64 bytes read for a directory, paid back by later directories
+    void addBytes(size_t bytes);
+
+private:
+    static constexpr std::chrono::milliseconds PAUSE_POLL_INTERVAL{100};
+
+    void refill();
+
+    std::mutex mutex;
+    double dirRate;
+    double byteRate;
+    double dirTokens;
+    double byteTokens;
+    std::chrono::steady_clock::time_point lastRefill;
+};
+
+// Lower the calling thread's CPU and I/O priority, threads it starts inherit both
+void lowerBackgroundPriority(const ScanRules& rules);
+
+
+// Append-only journal of an interactive import, an interrupted import with the same roots resumes from it
+class ImportJournal {
+public:
+    // Reuses the journal left by an interrupted import of the same roots, depth and pruning rules, starts a new one otherwise
+    ImportJournal(const std::vector<std::string>& roots, int maxDepth, const ScanRules& rules);
+    ~ImportJournal();
+    ImportJournal(const ImportJournal&) = delete;
+    ImportJournal& operator=(const ImportJournal&) = delete;
+
+    bool resumed() const { return !recoveredIso.empty() || !completed.empty(); }
+    const std::vector<std::string>& recoveredIsoFiles() const { return recoveredIso; }
+    size_t completedCount() const { return completed.size(); }
+
+    // True for folders whose whole subtree was finished before the interruption
+    bool isCompleted(const std::string& dir) const { return completed.count(dir) > 0; }
+
+    void recordIso(const std::string& isoPath);
+    void recordCompleted(const std::string& dir);
+
+    // The import is saved to the cache, remove the journal
+    void finish();
+
+private:
+    static constexpr std::chrono::milliseconds FLUSH_INTERVAL{250};
+    static constexpr size_t FLUSH_BYTES = 64 * 1024;
+
+    void append(char tag, const std::string& value);
+    void flushLocked();
+
+    std::vector<std::string> recoveredIso;
+    std::unordered_set<std::string> completed; // Read-only once the walkers start
+    std::mutex mutex;
+    std::string pending;                       // Lines not yet written, in record order
+    std::chrono::steady_clock::time_point lastFlush;
+    int fd = -1;
+};
+
+
+// Low-level recursive directory walker built on getdents64 and openat
+class DirectoryWalker {
+public:
+    // Called for every regular file: raw entry name and the walker's reusable full path buffer
+    using FileCallback = std::function<void(std::string_view name, const std::string& fullPath)>;
+
+    DirectoryWalker(int maxDepth, const ScanRules& rules, FileCallback onFile, std::vector<std::string>& errors, VisitedDirectories* sharedVisited = nullptr);
+
+    // Walk a root directory, errors are appended as "path - reason" instead of aborting the walk
+    void walk(const std::string& root);
+
+    // Pace the walk with a background throttle, nullptr walks at full speed
+    void setThrottle(BackgroundThrottle* backgroundThrottle) { throttle = backgroundThrottle; }
+    // Record finished folders to an import journal and skip the ones it already has
+    void setJournal(ImportJournal* importJournal) { journal = importJournal; }
+
+private:
+    static constexpr size_t DENTS_BUFFER_SIZE = 256 * 1024; // Large buffer keeps getdents64 calls per directory low
+
+    void walkDirectory(int dirFd, dev_t dirDev, int depth);
+    void addError(const std::string& path, int errorNumber);
+    bool isExcluded() const;
+    bool isPruned(int childFd, dev_t parentDev, dev_t& childDev) const;
+
+    int maxDepth;
+    const ScanRules& rules;
+    dev_t rootDev = 0;
+    VisitedDirectories* visited;
+    std::unique_ptr<VisitedDirectories> ownVisited;
+    BackgroundThrottle* throttle = nullptr;
+    ImportJournal* journal = nullptr;
+    FileCallback onFile;
+    std::vector<std::string>& errors;
+    std::vector<char> buffer;   // getdents64 buffer, reused for every directory
+    std::string path;           // Current path, grown and shrunk in place
+};
+
+// Scan progress counted per worker and printed by a single render thread, workers never touch stdio
+class ScanProgress {
+public:
+    // Counter owned by one worker, padded so workers never share a cache line
+    struct alignas(64) Slot {
+        std::atomic<size_t> count{0};
+    };
+
+    ScanProgress() = default;
+    ~ScanProgress();
+    ScanProgress(const ScanProgress&) = delete;
+    ScanProgress& operator=(const ScanProgress&) = delete;
+
+    // Start the render thread, calling it again while running is a no-op
+    void start();
+    // Stop the render thread and print the exact final count if it was running
+    void stop();
+    // Hand a worker its own counter, slots are reused round-robin past SLOT_COUNT workers
+    Slot& acquireSlot();
+    size_t total() const;
+
+private:
+    static constexpr size_t SLOT_COUNT = 64;
+    static constexpr std::chrono::milliseconds FRAME_INTERVAL{66}; // About 15 frames per second
+
+    void renderLoop();
+    void renderFrame(size_t count);
+
+    std::array<Slot, SLOT_COUNT> slots;
+    std::atomic<size_t> nextSlot{0};
+    std::mutex renderMutex;
+    std::condition_variable renderCv;
+    bool running = false;
+    std::thread renderer;
+};
+
+// Image formats recognised by the single-pass discovery
+enum class ImageKind { None, Iso, BinImg, Mdf, Nrg };
+
+// Candidates of every format found by one discovery pass, merged from the walker threads
+struct DiscoveredImages {
+    std::mutex mutex;
+    std::vector<std::string> iso, binImg, mdf, nrg;
+
+    // Move a walker's batch of one format into the pass, the batch is left empty
+    void append(ImageKind kind, std::vector<std::string>& local) {
+        if (local.empty()) return;
+        std::vector<std::string>& found = (kind == ImageKind::Iso) ? iso : (kind == ImageKind::BinImg) ? binImg : (kind == ImageKind::Mdf) ? mdf : nrg;
+        std::lock_guard<std::mutex> lock(mutex);
+        found.insert(found.end(), std::make_move_iterator(local.begin()), std::make_move_iterator(local.end()));
+        local.clear();
+    }
+};
+
+// Classify a raw entry name by extension
+ImageKind classifyImageName(std::string_view name);
+
+// Check the on-disk signature of a candidate for its format
+bool matchesImageMagic(const std::string& path, ImageKind kind);
+
+// Persist the candidates of a discovery pass and mark its roots as fresh for the other modes
+void publishDiscoveredImages(DiscoveredImages& discovered, const std::vector<std::string>& roots, const std::string& scannedMode);
+
+// Returns true once if a root was discovered by another mode's pass, so the caller can skip walking it
+bool consumeDiscoveredRoot(const std::string& root, const std::string& mode);
+
+
+// Case-insensitive suffix check on raw name bytes, suffix must be lowercase
+inline bool hasSuffixIgnoreCase(std::string_view name, std::string_view suffix) {
+    if (name.size() <= suffix.size()) return false;
+    const char* tail = name.data() + name.size() - suffix.size();
+    for (size_t i = 0; i < suffix.size(); ++i) {
+        char c = tail[i];
+        if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+        if (c != suffix[i]) return false;
+    }
+    return true;
+}
+
+#endif // SCAN_H
@@ -0,0 +1,222 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#ifndef SEARCH_H
+#define SEARCH_H
+#include "headers.h"
+#include <array>
+
+
+// Bytes readable past the end of every index row, enough for one 64-byte vector load
+constexpr size_t SUBSTRING_PADDING = 64;
+
+// Substring search kernels, chosen once per process from what the CPU supports
+enum class SubstringKernel { Scalar, Sse2, Avx2, Avx512 };
+
+bool substringKernelSupported(SubstringKernel kernel);
+SubstringKernel bestSubstringKernel();
+const char* substringKernelName(SubstringKernel kernel);
+
+// Query token prepared once per query: lowercased and bound to a kernel
+class CompiledToken {
+public:
+    using ContainsFn = bool (*)(const char* text, size_t textLen, const char* needle, size_t needleLen);
+
+    explicit CompiledToken(std::string token, SubstringKernel kernel = bestSubstringKernel());
+
+    // True if the token occurs in text, SUBSTRING_PADDING bytes past text must be readable
+    bool foundIn(std::string_view paddedText) const {
+        return needle.empty() || contains(paddedText.data(), paddedText.size(), needle.data(), needle.size());
+    }
+
+    const std::string& text() const { return needle; }
+
+private:
+    std::string needle;
+    ContainsFn contains;
+};
+
+
+// fzf-style fuzzy match of a lowercase pattern against a normalized row, pattern bytes must appear in order.
+// Matches at word boundaries, in runs and inside the file name score higher, gaps score lower.
+bool fuzzyMatch(std::string_view text, std::string_view pattern, int& score);
+
+
+// Glob or regular expression compiled to a DFA, matching costs one table lookup per row byte
+// with no backtracking and no allocation. Letters match either case, the rows are lowercase.
+class PatternDfa {
+public:
+    static constexpr size_t MAX_STATES = 4096; // Patterns that need more states are rejected
+
+    struct PatternNode; // Syntax tree both pattern forms are parsed into
+
+    // Compile a glob matched against the whole row: * any run of bytes, ? one byte, [...] one byte of a set
+    bool compileGlob(std::string_view pattern, std::string& error);
+    // Compile a regular expression found anywhere in the row, ^ and $ anchor it to the row ends
+    bool compileRegex(std::string_view pattern, std::string& error);
+
+    bool matches(std::string_view row) const;
+    size_t stateCount() const { return accepting.size(); }
+
+private:
+    static constexpr uint32_t DEAD_STATE = 0;   // No match is possible any more
+
+    bool build(const PatternNode& root, std::string& error);
+
+    std::array<uint16_t, 256> symbolClass{}; // Bytes no pattern part tells apart share a class
+    size_t classCount = 0;
+    std::vector<uint32_t> transitions;       // state * classCount + class to the next state's offset, state * classCount
+    std::vector<uint8_t> accepting;          // States where the match is already certain
+    std::vector<uint8_t> acceptingAtEnd;     // States that match if the row ends there
+    size_t terminalStates = 0;               // Dead and accepting states are numbered first
+    uint32_t startState = DEAD_STATE;        // Offset of the start state
+    bool matchesEmpty = false;
+};
+
+
+// Append UTF-8 text with Unicode simple case folding, and without diacritics if stripMarks is set.
+// Patterns pass foldAscii false, their ASCII letters keep the case that escapes like \D depend on.
+void appendFolded(std::string_view text, std::string& out, bool stripMarks, bool foldAscii = true);
+std::string foldedText(std::string_view text, bool stripMarks);
+
+
+class SearchIndex;
+
+// Inverted index from every 3-byte sequence of the normalized rows to the rows containing it.
+// Rows are tracked by document ids that survive reloads, so a changed list only indexes its new rows.
+class TrigramIndex {
+public:
+    // Index every row, blocks of rows are counted and then written in parallel
+    void build(const SearchIndex& rows, size_t threads);
+
+    // Carry the documents of unchanged rows over to the reloaded rows and index only the added ones.
+    // Returns false when the lists differ too much and a full build is cheaper.
+    bool update(const SearchIndex& previousRows, const SearchIndex& rows);
+
+    // Rows that may match any of the tokens, ascending; false if a token is too short to use the index
+    bool candidates(const std::vector<CompiledToken>& tokens, std::vector<uint32_t>& rows) const;
+
+private:
+    static constexpr uint32_t REMOVED = UINT32_MAX;     // Row of a document that left the list
+    static constexpr size_t TRIGRAM_WORDS = (1u << 24) / 64; // One bit per possible trigram
+
+    // Document ids of one trigram, ascending
+    struct PostingList {
+        const uint32_t* ids;
+        size_t size;
+    };
+
+    bool denseId(uint32_t trigram, uint32_t& id) const;
+
+    std::vector<uint64_t> present;               // Trigrams that occur in the built rows
+    std::vector<uint32_t> rankBase;              // Set bits of present before each word, gives dense ids
+    std::vector<size_t> starts;                  // Dense id to its first entry in ids
+    std::vector<uint32_t> ids;                   // Postings of all built rows, grouped by trigram
+    std::unordered_map<uint32_t, std::vector<uint32_t>> appended; // Postings of rows added by update()
+    std::vector<uint32_t> docRow;                // Current row of each document
+    std::vector<uint32_t> rowDoc;                // Document of each current row
+    size_t removedDocs = 0;                      // Documents still listed in postings but gone from the list
+};
+
+
+// Filter-ready copies of a file list: ANSI codes stripped and Unicode case folded,
+// stored back to back in one buffer so a query is a linear scan over cache-resident bytes
+class SearchIndex {
+public:
+    // Rebuild the index for a list, one allocation for the bytes and one for the offsets
+    void build(const std::vector<std::string>& files);
+
+    // Keep the index in line with a reloaded list, rebuilt only when the list actually changed
+    void sync(const std::vector<std::string>& files);
+
+    void clear();
+
+    // Fold the rows without diacritics, queries have to be folded the same way
+    void setStripMarks(bool strip);
+    bool stripsMarks() const { return stripMarks; }
+
+    // Maintain a trigram index next to the rows, built right away with up to threads workers
+    void enableTrigrams(size_t threads);
+    void disableTrigrams();
+
+    // Rows worth verifying for a query, false when the caller has to scan every row
+    bool candidateRows(const std::vector<CompiledToken>& tokens, std::vector<uint32_t>& rows) const {
+        return trigrams && trigrams->candidates(tokens, rows);
+    }
+
+    size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+
+    // Normalized bytes of one row
+    std::string_view row(size_t index) const {
+        return std::string_view(buffer.data() + offsets[index], offsets[index + 1] - offsets[index]);
+    }
+
+private:
+    static uint64_t fingerprint(const std::vector<std::string>& files);
+
+    void buildRows(const std::vector<std::string>& files);
+
+    std::string buffer;               // All normalized rows, back to back, then SUBSTRING_PADDING zero bytes
+    std::vector<size_t> offsets;      // Row i spans [offsets[i], offsets[i + 1])
+    uint64_t listFingerprint = 0;     // Hash of the raw list the index was built from
+    std::unique_ptr<TrigramIndex> trigrams;
+    size_t trigramThreads = 0;        // 0 while trigrams are disabled
+    bool stripMarks = false;          // Rows are folded without diacritics
+};
+
+// Append the filter form of a path to out: ANSI codes removed, then folded as by appendFolded
+void appendNormalized(const std::string& input, std::string& out, bool stripMarks = false);
+
+// Index of globalIsoFileList, synced whenever the ISO list is reloaded
+extern SearchIndex globalIsoSearchIndex;
+
+
+// A numbered list over a sorted catalog: every row, or the row ids the filters kept in display order.
+// Filtering a filtered view only tests its rows, clearing the filter drops them, no path is copied or re-sorted.
+class ListView {
+public:
+    explicit ListView(const std::vector<std::string>& catalog) : catalog(&catalog) {}
+
+    size_t size() const { return filtered ? rows.size() : catalog->size(); }
+    bool empty() const { return size() == 0; }
+
+    // Path at a 0-based display position
+    const std::string& operator[](size_t position) const { return (*catalog)[catalogRow(position)]; }
+    uint32_t catalogRow(size_t position) const { return filtered ? rows[position] : static_cast<uint32_t>(position); }
+
+    bool isFiltered() const { return filtered; }
+    const std::vector<std::string>& base() const { return *catalog; }
+    // Rows kept by the filters, nullptr while the whole catalog is shown
+    const std::vector<uint32_t>* filteredRows() const { return filtered ? &rows : nullptr; }
+
+    void setRows(std::vector<uint32_t> keptRows) {
+        rows = std::move(keptRows);
+        filtered = true;
+    }
+    void clearFilter() {
+        rows.clear();
+        filtered = false;
+    }
+
+    std::vector<std::string> paths() const;
+    // Find the shown paths again after the catalog was reloaded, the filter is cleared when none is left
+    void restorePaths(const std::vector<std::string>& shownPaths);
+
+private:
+    const std::vector<std::string>* catalog;
+    std::vector<uint32_t> rows;
+    bool filtered = false;
+};
+
+
+// Filter settings read from the user config
+struct FilterRules {
+    bool trigramIndex = false;        // Keep a trigram index of the ISO list, costs about 4 bytes per path byte
+    bool liveFilter = true;           // Show matches while the filter terms are typed
+    bool ignoreAccents = false;       // Match letters with and without diacritics alike
+    size_t fuzzyResults = 100;        // Best matches kept by a '~' fuzzy filter
+};
+
+// Load filter settings, defaults are used for missing keys
+FilterRules loadFilterRules();
+
+#endif // SEARCH_H